@@ -0,0 +1,116 @@
+#include "common_util/async_file_reader.hpp"
+#include "common_util/command_line_util.hpp"
+#include "common_util/memory_map_util.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+/*
+Cold cache sequential scan, RMemoryMapped against AsyncFileReader with io_uring and with the pread thread pool.
+Before every run the file's pages are dropped from the page cache (fdatasync + POSIX_FADV_DONTNEED). Results as JSON.
+  common_util_async_read_bench --megabytes=4096 --file=/nvme/scan.bin --queue_depth=64 --block_kb=1024
+The file has to live on the device under test, /tmp is often tmpfs where nothing is cold and O_DIRECT is refused.
+*/
+namespace {
+
+using common_util::AsyncReadOptions;
+using Clock = std::chrono::steady_clock;
+
+void write_file(const std::string &filename, size_t bytes) {
+  common_util::WMemoryMapped<uint64_t> file(filename, bytes);
+  uint64_t value = 0x9e3779b97f4a7c15ull;
+  for (uint64_t &word : file) {
+    value ^= value << 13;
+    value ^= value >> 7;
+    value ^= value << 17;
+    word = value;
+  }
+  file.flush();
+}
+
+void drop_page_cache(const std::string &filename) {
+  const int file = ::open(filename.c_str(), O_RDONLY);
+  if (file == -1)
+    return;
+  ::fdatasync(file);
+  ::posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(file);
+}
+
+double gigabytes_per_second(size_t bytes, Clock::time_point start) {
+  return static_cast<double>(bytes) / std::chrono::duration<double>(Clock::now() - start).count() / 1e9;
+}
+
+double scan_mapped(const std::string &filename, uint64_t &checksum) {
+  drop_page_cache(filename);
+  const auto start = Clock::now();
+  common_util::MapPolicy policy;
+  policy.access = common_util::MapPolicy::Access::SEQUENTIAL;
+  common_util::RMemoryMapped<uint64_t> file(filename, policy);
+  uint64_t sum = 0;
+  for (const uint64_t word : file)
+    sum += word;
+  checksum += sum;
+  return gigabytes_per_second(file.size() * sizeof(uint64_t), start);
+}
+
+double scan_async(const std::string &filename, const AsyncReadOptions &options, uint64_t &checksum, bool &direct) {
+  drop_page_cache(filename);
+  const auto start = Clock::now();
+  common_util::AsyncFileReader<uint64_t> file(filename, options);
+  uint64_t sum = 0;
+  for (auto batch = file.next_batch(); batch.second; batch = file.next_batch())
+    for (size_t i = 0; i < batch.second; ++i)
+      sum += batch.first[i];
+  checksum += sum;
+  direct = file.direct();
+  return gigabytes_per_second(file.size() * sizeof(uint64_t), start);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = 1024;
+  std::string filename = "/var/tmp/common_util_async_read_bench.bin";
+  AsyncReadOptions options;
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "megabytes")
+      megabytes = std::stoul(value);
+    else if (name == "file")
+      filename = value;
+    else if (name == "queue_depth")
+      options.queue_depth = std::stoul(value);
+    else if (name == "block_kb")
+      options.block_size = std::stoul(value) << 10;
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  write_file(filename, megabytes << 20);
+  uint64_t checksum = 0;
+  std::printf("{\"benchmark\": \"async_read\", \"megabytes\": %zu, \"queue_depth\": %zu, \"block_bytes\": %zu, "
+              "\"results\": [",
+              megabytes, options.queue_depth, options.block_size);
+  std::printf("\n  {\"reader\": \"mmap\", \"cold_gb_per_s\": %.2f}", scan_mapped(filename, checksum));
+  for (const auto backend : {AsyncReadOptions::Backend::IO_URING, AsyncReadOptions::Backend::PREAD}) {
+    const char *name = backend == AsyncReadOptions::Backend::IO_URING ? "io_uring" : "pread_pool";
+    options.backend = backend;
+    try {
+      bool direct = false;
+      const double throughput = scan_async(filename, options, checksum, direct);
+      std::printf(",\n  {\"reader\": \"%s\", \"direct\": %s, \"cold_gb_per_s\": %.2f}", name,
+                  direct ? "true" : "false", throughput);
+    } catch (const std::system_error &error) {
+      std::printf(",\n  {\"reader\": \"%s\", \"error\": \"%s\"}", name, error.what());
+    }
+  }
+  std::printf("],\n \"checksum\": %llu}\n", static_cast<unsigned long long>(checksum));
+  ::unlink(filename.c_str());
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "common_util/command_line_util.hpp"
+#include "common_util/integer_codec.hpp"
+#include "common_util/memory_map_util.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+Compression ratio and decode speed of integer_codec on tick like data, results as one JSON document.
+For each data set: encoded bytes per value, block decode throughput of every kernel this CPU runs, and a summing scan
+of the EncodedColumn file against the same scan of the plain int64 file through RMemoryMapped (both warm).
+  common_util_codec_bench --values=10000000 --dir=/data
+*/
+namespace {
+
+using Clock = std::chrono::steady_clock;
+namespace codec = common_util::integer_codec;
+
+struct Kernel {
+  const char *name;
+  codec::DecodeBlock decode;
+};
+
+std::vector<Kernel> kernels() {
+  std::vector<Kernel> result = {{"scalar", codec::decode_block_scalar}};
+#ifdef COMMON_UTIL_CODEC_X86
+  if (__builtin_cpu_supports("sse4.1"))
+    result.push_back({"sse4.1", codec::decode_block_sse41});
+  if (__builtin_cpu_supports("avx2"))
+    result.push_back({"avx2", codec::decode_block_avx2});
+#endif
+  return result;
+}
+
+// nanosecond timestamps about a millisecond apart
+std::vector<int64_t> timestamps(size_t count, std::mt19937_64 &random) {
+  std::vector<int64_t> values(count);
+  int64_t timestamp = 1700000000000000000;
+  for (int64_t &value : values)
+    value = timestamp += 1000000 + static_cast<int64_t>(random() % 2000);
+  return values;
+}
+
+// prices in ticks, random walk of a few ticks per step
+std::vector<int64_t> prices(size_t count, std::mt19937_64 &random) {
+  std::vector<int64_t> values(count);
+  int64_t price = 4500000;
+  for (int64_t &value : values)
+    value = price += static_cast<int64_t>(random() % 7) - 3;
+  return values;
+}
+
+double seconds_since(Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); }
+
+void run(const char *name, const std::vector<int64_t> &values, const std::string &dir, const char *separator,
+         uint64_t &checksum) {
+  const std::string plain_path = dir + "/common_util_codec_bench.plain";
+  const std::string encoded_path = dir + "/common_util_codec_bench.dzbp";
+  {
+    common_util::WMemoryMapped<int64_t> plain(plain_path, values.size() * sizeof(int64_t));
+    std::copy(values.begin(), values.end(), plain.begin());
+    plain.flush();
+  }
+  auto start = Clock::now();
+  {
+    common_util::EncodedColumnWriter writer(encoded_path);
+    writer.append(values.data(), values.size());
+    writer.close();
+  }
+  const double encode_seconds = seconds_since(start);
+
+  common_util::EncodedColumn column(encoded_path);
+  std::printf("%s\n  {\"data\": \"%s\", \"values\": %zu, \"encoded_bytes\": %zu, \"bytes_per_value\": %.3f, "
+              "\"encode_mvalues_per_s\": %.1f, \"decode_mvalues_per_s\": {",
+              separator, name, values.size(), column.encoded_bytes(),
+              static_cast<double>(column.encoded_bytes()) / static_cast<double>(values.size()),
+              static_cast<double>(values.size()) / encode_seconds / 1e6);
+
+  // every block of the file through one kernel, repeated so small files still take measurable time
+  common_util::RMemoryMapped<char> file(encoded_path);
+  std::vector<size_t> offsets;
+  for (size_t offset = common_util::encoded_column::header_size; offsets.size() < column.block_count();
+       offset += codec::block_bytes(file.begin() + offset))
+    offsets.push_back(offset);
+  alignas(32) int64_t buffer[codec::block_values];
+  const char *kernel_separator = "";
+  for (const Kernel &kernel : kernels()) {
+    start = Clock::now();
+    for (int round = 0; round < 5; ++round)
+      for (const size_t offset : offsets) {
+        kernel.decode(file.begin() + offset, buffer);
+        checksum += static_cast<uint64_t>(buffer[codec::block_values - 1]);
+      }
+    std::printf("%s\"%s\": %.1f", kernel_separator, kernel.name,
+                5.0 * static_cast<double>(values.size()) / seconds_since(start) / 1e6);
+    kernel_separator = ", ";
+  }
+
+  start = Clock::now();
+  uint64_t sum = 0;
+  column.for_each_block([&](const int64_t *block, size_t count, uint64_t) {
+    for (size_t i = 0; i < count; ++i)
+      sum += static_cast<uint64_t>(block[i]);
+  });
+  const double encoded_scan = static_cast<double>(values.size()) / seconds_since(start) / 1e6;
+  start = Clock::now();
+  common_util::RMemoryMapped<int64_t> plain(plain_path);
+  for (const int64_t value : plain)
+    sum += static_cast<uint64_t>(value);
+  const double plain_scan = static_cast<double>(values.size()) / seconds_since(start) / 1e6;
+  checksum += sum;
+  std::printf("}, \"scan_mvalues_per_s\": {\"encoded\": %.1f, \"plain\": %.1f}}", encoded_scan, plain_scan);
+  ::unlink(plain_path.c_str());
+  ::unlink(encoded_path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t count = 10000000;
+  std::string dir = "/tmp";
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "values")
+      count = std::stoul(value);
+    else if (name == "dir")
+      dir = value;
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  std::mt19937_64 random(42);
+  uint64_t checksum = 0;
+  std::printf("{\"benchmark\": \"integer_codec\", \"kernel\": \"%s\", \"results\": [",
+              codec::decode_kernel_name());
+  run("timestamps", timestamps(count, random), dir, "", checksum);
+  run("prices", prices(count, random), dir, ",", checksum);
+  std::printf("],\n \"checksum\": %llu}\n", static_cast<unsigned long long>(checksum));
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include "common_util/Logger.hpp"
+#include "common_util/log_prefix.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/*
+Per line cost of building "[timestamp] [thread id] [SEVERITY] message".
+before: what Logger::log did per line up to now, after: LogPrefix into a reused buffer.
+*/
+namespace {
+
+using Severity = common_util::Logger::Severity;
+constexpr size_t line_count = 1'000'000;
+
+std::string before_timestamp() {
+  auto now = std::chrono::system_clock::now();
+  auto now_time = std::chrono::system_clock::to_time_t(now);
+  auto in_milisecond = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+  std::tm tm = *std::localtime(&now_time);
+  std::ostringstream string_stream;
+  string_stream << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+  string_stream << '.' << std::setw(3) << std::setfill('0') << in_milisecond.count();
+  return string_stream.str();
+}
+
+std::string before_thread_id() {
+  std::ostringstream string_stream;
+  string_stream << std::dec << std::this_thread::get_id();
+  return string_stream.str();
+}
+
+std::string before_severity(const Severity severity) {
+  std::string result{"NONE"};
+  const std::unordered_map<Severity, std::string> severity_string_map{{Severity::DEBUG, "DEBUG"},
+                                                                      {Severity::INFO, "INFO"},
+                                                                      {Severity::WARNING, "WARNING"},
+                                                                      {Severity::ERROR, "ERROR"}};
+  if (severity_string_map.count(severity))
+    result = severity_string_map.at(severity);
+  return result;
+}
+
+std::string place_in_bracket(std::string value) { return "[" + value + "]"; }
+
+template <typename Function> double nanoseconds_per_line(Function &&function) {
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < line_count; ++i)
+    function(i);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / line_count;
+}
+
+} // namespace
+
+int main() {
+  const std::string message = "order book updated";
+  size_t checksum = 0;
+
+  const double before = nanoseconds_per_line([&](size_t i) {
+    const Severity severity = static_cast<Severity>(i & 3);
+    std::string log = place_in_bracket(before_timestamp()) + " " + place_in_bracket(before_thread_id()) + " " +
+                      place_in_bracket(before_severity(severity)) + " " + message;
+    checksum += log.size();
+  });
+
+  std::string line;
+  line.reserve(256);
+  constexpr std::string_view severity_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+  const double after = nanoseconds_per_line([&](size_t i) {
+    char timestamp[common_util::LogPrefix::timestamp_size];
+    common_util::LogPrefix::write_timestamp(timestamp);
+    line.clear();
+    common_util::LogPrefix::append(line, std::string_view(timestamp, sizeof(timestamp)),
+                                   common_util::LogPrefix::this_thread_id(), severity_names[i & 3]);
+    line.append(message);
+    checksum += line.size();
+  });
+
+  std::printf("{\"benchmark\": \"log_prefix\", \"lines\": %zu, \"before_ns_per_line\": %.1f, "
+              "\"after_ns_per_line\": %.1f, \"speedup\": %.1f, \"checksum\": %zu}\n",
+              line_count, before, after, before / after, checksum);
+  return 0;
+}
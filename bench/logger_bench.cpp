@@ -0,0 +1,231 @@
+#include "common_util/Logger.hpp"
+#include "common_util/command_line_util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+Logger throughput and tail latency, results go out as one JSON document.
+  - throughput: messages per second through log() with 1, 2, 4 ... --threads producers, sync and async, FILE output.
+    The clock stops once flush() returned, so async numbers include draining the queue.
+  - latency: duration of every single log() call per OutputMode, sync and async, reported as p50/p99/p99.9/max.
+    In async mode that's the enqueue cost. Each call is timed with steady_clock, which adds ~20ns to every sample.
+  - api: ns per message of the streaming operator<< against log() with the same text, one thread.
+Console output goes to /dev/null while measuring, the JSON is written to --output (default stdout).
+  common_util_bench --threads=8 --messages=200000 --dir=/tmp --output=bench.json
+*/
+namespace {
+
+using common_util::Logger;
+using Severity = Logger::Severity;
+using OutputMode = Logger::OutputMode;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  size_t threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+  size_t messages = 200'000; // per producer thread
+  std::string log_filename = "/tmp/common_util_bench.log";
+};
+
+const char *mode_name(bool async) { return async ? "async" : "sync"; }
+
+const char *output_name(OutputMode output_mode) {
+  switch (output_mode) {
+  case OutputMode::CONSOLE:
+    return "CONSOLE";
+  case OutputMode::FILE:
+    return "FILE";
+  case OutputMode::UBIQUITOUS:
+    return "UBIQUITOUS";
+  }
+  return "NONE";
+}
+
+// every run gets a fresh named instance, nothing carries over from the previous one
+Logger &open_logger(const Options &options, OutputMode output_mode, bool async) {
+  static size_t run = 0;
+  Logger &logger = Logger::get_instance("common_util_bench_" + std::to_string(run++));
+  logger.init(options.log_filename, Severity::DEBUG, output_mode);
+  if (async)
+    logger.set_async_mode(Logger::default_async_queue_capacity, Logger::OverflowPolicy::BLOCK);
+  logger.open();
+  return logger;
+}
+
+void close_logger(const Options &options, Logger &logger) {
+  logger.close();
+  ::unlink(options.log_filename.c_str());
+}
+
+// "order 123 qty 45 px 10007", same text for both APIs
+void format_message(std::string &message, size_t i) {
+  message.assign("order ");
+  message.append(std::to_string(i));
+  message.append(" qty ");
+  message.append(std::to_string(i % 100));
+  message.append(" px ");
+  message.append(std::to_string(10000 + i % 17));
+}
+
+template <typename Producer> void run_producers(size_t threads, Producer &&producer) {
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (size_t t = 0; t < threads; ++t)
+    workers.emplace_back(producer, t);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+double throughput(const Options &options, size_t threads, bool async) {
+  Logger &logger = open_logger(options, OutputMode::FILE, async);
+  const auto start = Clock::now();
+  run_producers(threads, [&](size_t) {
+    std::string message;
+    for (size_t i = 0; i < options.messages; ++i) {
+      format_message(message, i);
+      logger.log(message, Severity::INFO);
+    }
+  });
+  logger.flush();
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  close_logger(options, logger);
+  return static_cast<double>(threads * options.messages) / seconds;
+}
+
+struct Percentiles {
+  uint64_t p50 = 0;
+  uint64_t p99 = 0;
+  uint64_t p999 = 0;
+  uint64_t max = 0;
+};
+
+Percentiles latency(const Options &options, OutputMode output_mode, bool async) {
+  Logger &logger = open_logger(options, output_mode, async);
+  std::vector<std::vector<uint64_t>> samples(options.threads);
+  run_producers(options.threads, [&](size_t t) {
+    std::vector<uint64_t> &thread_samples = samples[t];
+    thread_samples.reserve(options.messages);
+    std::string message;
+    for (size_t i = 0; i < options.messages; ++i) {
+      format_message(message, i);
+      const auto start = Clock::now();
+      logger.log(message, Severity::INFO);
+      const auto elapsed = Clock::now() - start;
+      thread_samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  });
+  logger.flush();
+  close_logger(options, logger);
+
+  std::vector<uint64_t> all;
+  all.reserve(options.threads * options.messages);
+  for (auto &thread_samples : samples)
+    all.insert(all.end(), thread_samples.begin(), thread_samples.end());
+  std::sort(all.begin(), all.end());
+  const auto at = [&](double quantile) { return all[static_cast<size_t>(quantile * (all.size() - 1))]; };
+  return {at(0.5), at(0.99), at(0.999), all.back()};
+}
+
+// ns per message, one producer
+double api_cost(const Options &options, bool streaming, bool async) {
+  Logger &logger = open_logger(options, OutputMode::FILE, async);
+  std::string message;
+  const auto start = Clock::now();
+  for (size_t i = 0; i < options.messages; ++i) {
+    if (streaming) {
+      logger(Severity::INFO) << "order " << i << " qty " << i % 100 << " px " << 10000 + i % 17 << Logger::endl;
+    } else {
+      format_message(message, i);
+      logger.log(message, Severity::INFO);
+    }
+  }
+  logger.flush();
+  const double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  close_logger(options, logger);
+  return nanoseconds / static_cast<double>(options.messages);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // keep the real stdout for the JSON, console sinks write into /dev/null
+  const int json_fd = ::dup(STDOUT_FILENO);
+  const int null_fd = ::open("/dev/null", O_WRONLY);
+  if (json_fd == -1 || null_fd == -1) {
+    std::perror("common_util_bench");
+    return 1;
+  }
+  ::dup2(null_fd, STDOUT_FILENO);
+  ::dup2(null_fd, STDERR_FILENO);
+
+  Options options;
+  std::string output_filename;
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "threads")
+      options.threads = std::max<size_t>(1, std::stoul(value));
+    else if (name == "messages")
+      options.messages = std::max<size_t>(1, std::stoul(value));
+    else if (name == "dir")
+      options.log_filename = value + "/common_util_bench.log";
+    else if (name == "output")
+      output_filename = value;
+  }
+  std::fflush(stdout);
+
+  FILE *json = output_filename.empty() ? ::fdopen(json_fd, "w") : std::fopen(output_filename.c_str(), "w");
+  if (!json) {
+    ::dup2(json_fd, STDERR_FILENO);
+    std::perror("common_util_bench");
+    return 1;
+  }
+
+  std::fprintf(json, "{\"benchmark\": \"logger\", \"messages_per_thread\": %zu, \"max_threads\": %zu,\n",
+               options.messages, options.threads);
+
+  std::fprintf(json, " \"throughput\": [");
+  const char *separator = "";
+  for (bool async : {false, true}) {
+    for (size_t threads = 1;; threads = std::min(threads * 2, options.threads)) {
+      std::fprintf(json,
+                   "%s\n  {\"mode\": \"%s\", \"output\": \"FILE\", \"threads\": %zu, \"messages_per_second\": %.0f}",
+                   separator, mode_name(async), threads, throughput(options, threads, async));
+      separator = ",";
+      if (threads == options.threads)
+        break;
+    }
+  }
+
+  std::fprintf(json, "],\n \"latency\": [");
+  separator = "";
+  for (bool async : {false, true}) {
+    for (OutputMode output_mode : {OutputMode::CONSOLE, OutputMode::FILE, OutputMode::UBIQUITOUS}) {
+      const Percentiles percentiles = latency(options, output_mode, async);
+      std::fprintf(json,
+                   "%s\n  {\"mode\": \"%s\", \"output\": \"%s\", \"threads\": %zu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+                   "\"p99_9_ns\": %llu, \"max_ns\": %llu}",
+                   separator, mode_name(async), output_name(output_mode), options.threads,
+                   static_cast<unsigned long long>(percentiles.p50), static_cast<unsigned long long>(percentiles.p99),
+                   static_cast<unsigned long long>(percentiles.p999), static_cast<unsigned long long>(percentiles.max));
+      separator = ",";
+    }
+  }
+
+  std::fprintf(json, "],\n \"api\": [");
+  separator = "";
+  for (bool async : {false, true}) {
+    for (bool streaming : {false, true}) {
+      std::fprintf(json, "%s\n  {\"api\": \"%s\", \"mode\": \"%s\", \"threads\": 1, \"ns_per_message\": %.1f}",
+                   separator, streaming ? "stream" : "log", mode_name(async), api_cost(options, streaming, async));
+      separator = ",";
+    }
+  }
+  std::fprintf(json, "]}\n");
+  std::fclose(json);
+  return 0;
+}
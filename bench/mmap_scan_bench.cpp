@@ -0,0 +1,120 @@
+#include "common_util/command_line_util.hpp"
+#include "common_util/memory_map_util.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+/*
+Cold and warm sequential scan throughput of RMemoryMapped for each MapPolicy, results as one JSON document.
+cold: the file's pages are dropped from the page cache first (fdatasync + POSIX_FADV_DONTNEED), warm: the same file
+scanned again right after through a new mapping. Both include the mmap/madvise/mlock setup time.
+  common_util_mmap_bench --megabytes=1024 --file=/data/scan.bin
+A policy the kernel refuses (mlock over RLIMIT_MEMLOCK, huge pages) is reported with its error instead of numbers.
+*/
+namespace {
+
+using common_util::MapPolicy;
+using Clock = std::chrono::steady_clock;
+
+struct Policy {
+  const char *name;
+  MapPolicy policy;
+};
+
+MapPolicy make_policy(bool populate, MapPolicy::HugePages huge_pages, bool lock, MapPolicy::Access access) {
+  MapPolicy policy;
+  policy.populate = populate;
+  policy.huge_pages = huge_pages;
+  policy.lock = lock;
+  policy.access = access;
+  return policy;
+}
+
+void write_file(const std::string &filename, size_t bytes) {
+  common_util::WMemoryMapped<uint64_t> file(filename, bytes);
+  uint64_t value = 0x9e3779b97f4a7c15ull;
+  for (uint64_t &word : file) {
+    value ^= value << 13;
+    value ^= value >> 7;
+    value ^= value << 17;
+    word = value;
+  }
+  file.flush();
+}
+
+void drop_page_cache(const std::string &filename) {
+  const int file = ::open(filename.c_str(), O_RDONLY);
+  if (file == -1)
+    return;
+  ::fdatasync(file);
+  ::posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(file);
+}
+
+// GB/s of mapping plus summing every word, checksum keeps the loop alive
+double scan(const std::string &filename, const MapPolicy &policy, uint64_t &checksum) {
+  const auto start = Clock::now();
+  common_util::RMemoryMapped<uint64_t> file(filename, policy);
+  uint64_t sum = 0;
+  for (const uint64_t word : file)
+    sum += word;
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  checksum += sum;
+  return static_cast<double>(file.size() * sizeof(uint64_t)) / seconds / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = 512;
+  std::string filename = "/tmp/common_util_mmap_bench.bin";
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "megabytes")
+      megabytes = std::stoul(value);
+    else if (name == "file")
+      filename = value;
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  using HugePages = MapPolicy::HugePages;
+  using Access = MapPolicy::Access;
+  const std::vector<Policy> policies = {
+      {"default", make_policy(false, HugePages::NONE, false, Access::NORMAL)},
+      {"populate", make_policy(true, HugePages::NONE, false, Access::NORMAL)},
+      {"sequential", make_policy(false, HugePages::NONE, false, Access::SEQUENTIAL)},
+      {"willneed", make_policy(false, HugePages::NONE, false, Access::WILLNEED)},
+      {"random", make_policy(false, HugePages::NONE, false, Access::RANDOM)},
+      {"transparent_huge_pages", make_policy(false, HugePages::TRANSPARENT, false, Access::NORMAL)},
+      {"populate_sequential_thp", make_policy(true, HugePages::TRANSPARENT, false, Access::SEQUENTIAL)},
+      {"mlock", make_policy(false, HugePages::NONE, true, Access::NORMAL)},
+  };
+
+  write_file(filename, megabytes << 20);
+  uint64_t checksum = 0;
+  std::printf("{\"benchmark\": \"mmap_scan\", \"megabytes\": %zu, \"results\": [", megabytes);
+  const char *separator = "";
+  for (const Policy &policy : policies) {
+    try {
+      drop_page_cache(filename);
+      const double cold = scan(filename, policy.policy, checksum);
+      const double warm = scan(filename, policy.policy, checksum);
+      std::printf("%s\n  {\"policy\": \"%s\", \"cold_gb_per_s\": %.2f, \"warm_gb_per_s\": %.2f}", separator,
+                  policy.name, cold, warm);
+    } catch (const std::system_error &error) {
+      std::printf("%s\n  {\"policy\": \"%s\", \"error\": \"%s\"}", separator, policy.name, error.what());
+    }
+    separator = ",";
+  }
+  std::printf("],\n \"checksum\": %llu}\n", static_cast<unsigned long long>(checksum));
+  ::unlink(filename.c_str());
+  return 0;
+}
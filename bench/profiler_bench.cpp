@@ -0,0 +1,84 @@
+#include "common_util/command_line_util.hpp"
+#include "common_util/profiler.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Cost of timing an empty scope, results as one JSON document.
+before: two std::chrono::steady_clock reads kept in a vector (what ad-hoc timing did before it was logged),
+after: ScopedTimer into a zone, on one thread and per sample with threads threads recording at once.
+  common_util_profiler_bench --iterations=10000000 --threads=4
+*/
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Function> double nanoseconds_per_iteration(size_t iterations, Function &&function) {
+  const auto start = Clock::now();
+  function();
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t iterations = 10000000;
+  size_t threads = 4;
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "iterations")
+      iterations = std::stoul(value);
+    else if (name == "threads")
+      threads = std::stoul(value);
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  std::vector<int64_t> durations;
+  durations.reserve(iterations);
+  const double before = nanoseconds_per_iteration(iterations, [&] {
+    for (size_t i = 0; i < iterations; ++i) {
+      const auto start = Clock::now();
+      durations.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+  });
+
+  static const common_util::ProfileZone zone("empty");
+  const double clock = nanoseconds_per_iteration(iterations, [&] {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < iterations; ++i)
+      sum += common_util::ProfileClock::now();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    durations[0] = static_cast<int64_t>(sum);
+  });
+  const double after = nanoseconds_per_iteration(iterations, [&] {
+    for (size_t i = 0; i < iterations; ++i)
+      common_util::ScopedTimer timer(zone);
+  });
+  const double contended = nanoseconds_per_iteration(iterations * threads, [&] {
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+      workers.emplace_back([&] {
+        for (size_t i = 0; i < iterations; ++i)
+          common_util::ScopedTimer timer(zone);
+      });
+    for (std::thread &worker : workers)
+      worker.join();
+  });
+
+  const std::vector<common_util::ProfileSummary> summaries =
+      common_util::Profiler::summarize(common_util::Profiler::get_instance().collect());
+  std::printf("{\"benchmark\": \"profiler\", \"iterations\": %zu, \"tsc\": %s, \"clock_read_ns\": %.2f, "
+              "\"before_ns\": %.2f, \"scoped_timer_ns\": %.2f, \"threads\": %zu, \"scoped_timer_threads_ns\": %.2f, "
+              "\"samples\": %llu}\n",
+              iterations, common_util::ProfileClock::uses_tsc() ? "true" : "false", clock, before, after, threads,
+              contended, static_cast<unsigned long long>(summaries.empty() ? 0 : summaries[0].count));
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "common_util/string_format_util.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Per line cost of a per bar report line "bar 17 open 4512.2500 high ... volume 1834".
+before: string_format up to now (std::ostringstream, std::fixed, setprecision(4)), after: string_format (to_chars into
+the thread's buffer, one std::string), string_format_to into a caller buffer and string_format_view.
+Every line of every variant is compared with before, "identical" says whether all matched.
+*/
+namespace {
+
+constexpr size_t line_count = 1'000'000;
+
+struct Bar {
+  double open, high, low, close;
+  int64_t volume;
+};
+
+template <typename... Args> std::string before_string_format(Args... args) {
+  std::ostringstream stream;
+  stream << std::fixed << std::setprecision(4);
+  (stream << ... << args);
+  return stream.str();
+}
+
+template <typename Function> double nanoseconds_per_line(Function &&function) {
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < line_count; ++i)
+    function(i);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / line_count;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937_64 random(7);
+  std::vector<Bar> bars(1024);
+  double price = 4500;
+  for (Bar &bar : bars) {
+    bar.open = price;
+    bar.high = price + static_cast<double>(random() % 400) * 0.25;
+    bar.low = price - static_cast<double>(random() % 400) * 0.25;
+    price = bar.close = bar.low + static_cast<double>(random() % 400) * 0.125;
+    bar.volume = static_cast<int64_t>(random() % 100000);
+  }
+  std::vector<std::string> expected(bars.size());
+  for (size_t i = 0; i < bars.size(); ++i) {
+    const Bar &bar = bars[i];
+    expected[i] = before_string_format("bar ", i, " open ", bar.open, " high ", bar.high, " low ", bar.low, " close ",
+                                       bar.close, " volume ", bar.volume);
+  }
+
+  size_t checksum = 0;
+  bool identical = true;
+  const double before = nanoseconds_per_line([&](size_t i) {
+    const Bar &bar = bars[i % bars.size()];
+    const std::string line = before_string_format("bar ", i % bars.size(), " open ", bar.open, " high ", bar.high,
+                                                  " low ", bar.low, " close ", bar.close, " volume ", bar.volume);
+    checksum += line.size();
+  });
+  const double string_format = nanoseconds_per_line([&](size_t i) {
+    const Bar &bar = bars[i % bars.size()];
+    const std::string line = common_util::string_format("bar ", i % bars.size(), " open ", bar.open, " high ",
+                                                        bar.high, " low ", bar.low, " close ", bar.close, " volume ",
+                                                        bar.volume);
+    identical &= line == expected[i % bars.size()];
+  });
+  char buffer[256];
+  const double string_format_to = nanoseconds_per_line([&](size_t i) {
+    const Bar &bar = bars[i % bars.size()];
+    const size_t length =
+        common_util::string_format_to(buffer, sizeof(buffer), "bar ", i % bars.size(), " open ", bar.open, " high ",
+                                      bar.high, " low ", bar.low, " close ", bar.close, " volume ", bar.volume);
+    identical &= std::string_view(buffer, length) == expected[i % bars.size()];
+  });
+  const double string_format_view = nanoseconds_per_line([&](size_t i) {
+    const Bar &bar = bars[i % bars.size()];
+    const std::string_view line =
+        common_util::string_format_view("bar ", i % bars.size(), " open ", bar.open, " high ", bar.high, " low ",
+                                        bar.low, " close ", bar.close, " volume ", bar.volume);
+    identical &= line == expected[i % bars.size()];
+  });
+
+  std::printf("{\"benchmark\": \"string_format\", \"lines\": %zu, \"before_ns_per_line\": %.1f, "
+              "\"string_format_ns_per_line\": %.1f, \"string_format_to_ns_per_line\": %.1f, "
+              "\"string_format_view_ns_per_line\": %.1f, \"speedup\": %.1f, \"identical\": %s, \"checksum\": %zu}\n",
+              line_count, before, string_format, string_format_to, string_format_view, before / string_format_to,
+              identical ? "true" : "false", checksum);
+  return identical ? 0 : 1;
+}
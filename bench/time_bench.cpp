@@ -0,0 +1,134 @@
+#include "common_util/command_line_util.hpp"
+#include "common_util/time_format.hpp"
+#include "common_util/time_parse.hpp"
+#include "common_util/time_util.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Per timestamp cost of parsing and formatting "YYYY-MM-DD HH:MM:SS", results as one JSON document.
+parse before: what convert_time_string did up to now (istringstream, std::get_time, timegm), after: convert_time_string,
+parse_time and the parse_times batch API.
+format before: what formate_time_utc did up to now (gmtime, put_time), after: formate_time_utc, UtcFormatter on one
+minute bars (date cached) and the bulk API. "identical" says whether every result matched before.
+  common_util_time_bench --timestamps=1000000
+*/
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string before_formate_time_utc(std::time_t time) {
+  std::ostringstream stream;
+  std::tm *utc = std::gmtime(&time);
+  stream << std::put_time(utc, "%Y-%m-%d %H:%M:%S");
+  return stream.str();
+}
+
+std::time_t before_convert_time_string(const std::string &text) {
+  std::tm tm = {};
+  std::istringstream string_stream(text);
+  string_stream >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+  if (string_stream.fail())
+    throw std::runtime_error("Failed to parse time string");
+  return timegm(&tm);
+}
+
+template <typename Function> double nanoseconds_per_timestamp(size_t count, Function &&function) {
+  const auto start = Clock::now();
+  function();
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t count = 1000000;
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "timestamps")
+      count = std::stoul(value);
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  std::mt19937_64 random(11);
+  std::vector<std::string> texts(count);
+  for (std::string &text : texts) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%04u-%02u-%02u %02u:%02u:%02u", static_cast<unsigned>(1990 + random() % 60),
+                  static_cast<unsigned>(1 + random() % 12), static_cast<unsigned>(1 + random() % 28),
+                  static_cast<unsigned>(random() % 24), static_cast<unsigned>(random() % 60),
+                  static_cast<unsigned>(random() % 60));
+    text = buffer;
+  }
+  const std::vector<std::string_view> views(texts.begin(), texts.end());
+
+  std::vector<int64_t> expected(count), times(count);
+  const double before = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      expected[i] = before_convert_time_string(texts[i]);
+  });
+  bool identical = true;
+  const double convert = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      times[i] = common_util::convert_time_string(texts[i]);
+  });
+  identical &= times == expected;
+  const double parse = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      common_util::parse_time<common_util::TimeLayout::DATE_TIME>(views[i], times[i]);
+  });
+  identical &= times == expected;
+  size_t failures = 0;
+  const double batch = nanoseconds_per_timestamp(count, [&] {
+    failures = common_util::parse_times<common_util::TimeLayout::DATE_TIME>(views.data(), count, times.data());
+  });
+  identical &= times == expected && failures == 0;
+
+  // one minute bars
+  std::vector<int64_t> bar_times(count);
+  for (size_t i = 0; i < count; ++i)
+    bar_times[i] = 1700000000 + static_cast<int64_t>(i) * 60;
+  std::vector<std::string> expected_texts(count);
+  const double format_before = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      expected_texts[i] = before_formate_time_utc(bar_times[i]);
+  });
+  bool format_identical = true;
+  const double formate_time_utc = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      format_identical &= common_util::formate_time_utc(bar_times[i]) == expected_texts[i];
+  });
+  common_util::UtcFormatter formatter;
+  char text[64];
+  const double utc_formatter = nanoseconds_per_timestamp(count, [&] {
+    for (size_t i = 0; i < count; ++i)
+      format_identical &= std::string_view(text, formatter.format(bar_times[i], text)) == expected_texts[i];
+  });
+  std::vector<char> column(count * (formatter.max_size() + 1));
+  size_t column_size = 0;
+  const double bulk = nanoseconds_per_timestamp(
+      count, [&] { column_size = formatter.format(bar_times.data(), count, column.data()); });
+  std::string expected_column;
+  for (const std::string &expected_text : expected_texts)
+    expected_column.append(expected_text).push_back('\n');
+  format_identical &= std::string_view(column.data(), column_size) == expected_column;
+
+  std::printf("{\"benchmark\": \"time\", \"timestamps\": %zu, \"parse\": {\"before_ns\": %.1f, "
+              "\"convert_time_string_ns\": %.1f, \"parse_time_ns\": %.1f, \"parse_times_ns\": %.1f, "
+              "\"speedup\": %.1f, \"identical\": %s},\n \"format\": {\"before_ns\": %.1f, "
+              "\"formate_time_utc_ns\": %.1f, \"utc_formatter_ns\": %.1f, \"bulk_ns\": %.1f, \"speedup\": %.1f, "
+              "\"identical\": %s}}\n",
+              count, before, convert, parse, batch, before / batch, identical ? "true" : "false", format_before,
+              formate_time_utc, utc_formatter, bulk, format_before / bulk, format_identical ? "true" : "false");
+  return identical && format_identical ? 0 : 1;
+}
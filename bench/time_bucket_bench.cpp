@@ -0,0 +1,145 @@
+#include "common_util/command_line_util.hpp"
+#include "common_util/memory_map_util.hpp"
+#include "common_util/time_bucket.hpp"
+#include "common_util/time_util.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Per timestamp cost of flooring / ceiling a mapped timestamp column to bar boundaries, results as one JSON document.
+before: one gmtime_r + timegm per value (plus add_months for the month ceiling), after: the time_bucket kernels over
+the RMemoryMapped column. "identical" says whether every boundary matched before.
+  common_util_time_bucket_bench --timestamps=10000000 --file=/tmp/time_bucket.bin
+*/
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// UTC fields of time with the seconds cleared
+std::tm utc_fields(int64_t time) {
+  const std::time_t seconds = static_cast<std::time_t>(time);
+  std::tm fields;
+  gmtime_r(&seconds, &fields);
+  fields.tm_sec = 0;
+  return fields;
+}
+
+int64_t before_floor_minute(int64_t time) {
+  std::tm fields = utc_fields(time);
+  return timegm(&fields);
+}
+
+int64_t before_floor_day(int64_t time) {
+  std::tm fields = utc_fields(time);
+  fields.tm_hour = fields.tm_min = 0;
+  return timegm(&fields);
+}
+
+int64_t before_floor_week(int64_t time) {
+  std::tm fields = utc_fields(time);
+  fields.tm_hour = fields.tm_min = 0;
+  fields.tm_mday -= (fields.tm_wday + 6) % 7;
+  return timegm(&fields);
+}
+
+int64_t before_floor_month(int64_t time) {
+  std::tm fields = utc_fields(time);
+  fields.tm_hour = fields.tm_min = 0;
+  fields.tm_mday = 1;
+  return timegm(&fields);
+}
+
+int64_t before_ceil_month(int64_t time) {
+  const int64_t floor = before_floor_month(time);
+  return floor == time ? floor : common_util::add_months(floor, 1);
+}
+
+template <typename Function> double nanoseconds_per_timestamp(size_t count, Function &&function) {
+  const auto start = Clock::now();
+  function();
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+}
+
+struct Bucket {
+  const char *name;
+  int64_t (*before)(int64_t);
+  std::function<void(const int64_t *, int64_t *, size_t)> after;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t count = 10000000;
+  std::string filename = (std::filesystem::temp_directory_path() / "common_util_time_bucket_bench.bin").string();
+  // get_command_line_argument echoes the arguments to std::cout, keep stdout pure JSON
+  std::streambuf *cout_buffer = std::cout.rdbuf(nullptr);
+  for (const auto &[name, value] : common_util::get_command_line_argument(argc, argv)) {
+    if (name == "timestamps")
+      count = std::stoul(value);
+    else if (name == "file")
+      filename = value;
+  }
+  std::cout.rdbuf(cout_buffer);
+  std::cout.clear();
+
+  {
+    // ticks from 2015 on, 0 - 60 seconds apart, a few exactly on a boundary
+    common_util::WMemoryMapped<int64_t> file(filename, count * sizeof(int64_t));
+    std::mt19937_64 random(23);
+    int64_t time = 1420070400;
+    for (int64_t &tick : file) {
+      time += static_cast<int64_t>(random() % 61);
+      tick = random() % 1000 == 0 ? time - time % 60 : time;
+    }
+    file.flush();
+  }
+  common_util::RMemoryMapped<int64_t> times(filename);
+  count = times.size();
+  const int64_t *ticks = times.begin();
+
+  const Bucket buckets[] = {
+      {"minute", before_floor_minute,
+       [](const int64_t *in, int64_t *out, size_t n) { common_util::time_bucket::floor(in, out, n, 60); }},
+      {"day", before_floor_day, [](const int64_t *in, int64_t *out, size_t n) {
+         common_util::time_bucket::floor_to_day(in, out, n);
+       }},
+      {"week", before_floor_week, [](const int64_t *in, int64_t *out, size_t n) {
+         common_util::time_bucket::floor_to_week(in, out, n);
+       }},
+      {"month", before_floor_month, [](const int64_t *in, int64_t *out, size_t n) {
+         common_util::time_bucket::floor_to_month(in, out, n);
+       }},
+      {"month_ceil", before_ceil_month, [](const int64_t *in, int64_t *out, size_t n) {
+         common_util::time_bucket::ceil_to_month(in, out, n);
+       }},
+  };
+
+  std::vector<int64_t> expected(count), bars(count);
+  bool all_identical = true;
+  std::printf("{\"benchmark\": \"time_bucket\", \"timestamps\": %zu, \"buckets\": [", count);
+  const char *separator = "";
+  for (const Bucket &bucket : buckets) {
+    const double before = nanoseconds_per_timestamp(count, [&] {
+      for (size_t i = 0; i < count; ++i)
+        expected[i] = bucket.before(ticks[i]);
+    });
+    const double after = nanoseconds_per_timestamp(count, [&] { bucket.after(ticks, bars.data(), count); });
+    const bool identical = bars == expected;
+    all_identical &= identical;
+    std::printf("%s\n {\"bucket\": \"%s\", \"before_ns\": %.2f, \"after_ns\": %.2f, \"speedup\": %.1f, "
+                "\"identical\": %s}",
+                separator, bucket.name, before, after, before / after, identical ? "true" : "false");
+    separator = ",";
+  }
+  std::printf("]}\n");
+  std::filesystem::remove(filename);
+  return all_identical ? 0 : 1;
+}
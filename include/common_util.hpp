@@ -1,7 +1,24 @@
 #include "common_util/Logger.hpp"
+#include "common_util/async_file_reader.hpp"
+#include "common_util/binary_log.hpp"
+#include "common_util/civil_time.hpp"
+#include "common_util/column_file.hpp"
 #include "common_util/command_line_util.hpp"
+#include "common_util/integer_codec.hpp"
 #include "common_util/iostream_util.hpp"
+#include "common_util/log_file.hpp"
+#include "common_util/log_prefix.hpp"
+#include "common_util/log_sink.hpp"
 #include "common_util/memory_map_util.hpp"
+#include "common_util/metrics.hpp"
+#include "common_util/mpsc_ring_buffer.hpp"
+#include "common_util/parallel_scan.hpp"
+#include "common_util/profiler.hpp"
+#include "common_util/record_layout.hpp"
 #include "common_util/string_format_util.hpp"
+#include "common_util/time_bucket.hpp"
+#include "common_util/time_format.hpp"
+#include "common_util/time_parse.hpp"
 #include "common_util/time_util.hpp"
+#include "common_util/timestamp_index.hpp"
 #include "endian/endian.hpp"
\ No newline at end of file
@@ -1,30 +1,45 @@
 #pragma once
+#include "log_file.hpp"
+#include "log_prefix.hpp"
+#include "log_sink.hpp"
+#include "mpsc_ring_buffer.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <ctime>
-#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
+#include <vector>
+
+/*
+Lowest severity compiled into the COMMON_UTIL_LOG_* macros: 0 DEBUG, 1 INFO, 2 WARNING, 3 ERROR, 4 none.
+Calls below it are discarded at compile time together with their arguments, e.g. -DCOMMON_UTIL_LOG_LEVEL=1 for
+release builds without debug logs.
+*/
+#ifndef COMMON_UTIL_LOG_LEVEL
+#define COMMON_UTIL_LOG_LEVEL 0
+#endif
+
 namespace common_util {
 
 class Logger final {
 public:
-  enum class Severity {
-    DEBUG,
-    INFO,
-    WARNING,
-    ERROR,
-  };
+  using Severity = LogSeverity;
 
   enum class OutputMode {
     CONSOLE,
@@ -32,6 +47,13 @@ public:
     UBIQUITOUS,
   };
 
+  // what an async log call does when the queue to the writer thread is full
+  enum class OverflowPolicy {
+    BLOCK,          // wait for the writer to free a slot
+    DROP,           // throw the record away
+    DROP_AND_COUNT, // throw the record away, the writer reports how many were dropped
+  };
+
   using type_timestamp_callback = std::function<std::string(void)>;
   using type_thread_id_callback = std::function<std::string(void)>;
 
@@ -39,51 +61,154 @@ private:
   type_timestamp_callback _timestamp_callback;
   type_thread_id_callback _thread_id_callback;
 
-  std::mutex _logfile_mutex;
-  std::mutex _partial_log_mutext;
+  // while the default callbacks are set the prefix is written by LogPrefix, not through the std::function
+  bool _default_timestamp = true;
+  bool _default_thread_id = true;
 
-  /*{thread_id: partial log buffer before flush gets called}*/
-  std::unordered_map<std::string, std::stringstream> _partial_log_line_map;
+  // streambuf appending straight into a std::string, formatting a token doesn't need a temporary string
+  class StringAppendBuffer final : public std::streambuf {
+  public:
+    explicit StringAppendBuffer(std::string &target) : _target(target) {}
 
-  /*{thread_id: it's log severity}*/
-  std::unordered_map<std::string, Severity> _partial_log_line_severity_map;
+  protected:
+    int_type overflow(int_type ch) override {
+      if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        _target.push_back(traits_type::to_char_type(ch));
+      return traits_type::not_eof(ch);
+    }
+    std::streamsize xsputn(const char *data, std::streamsize count) override {
+      _target.append(data, static_cast<size_t>(count));
+      return count;
+    }
 
+  private:
+    std::string &_target;
+  };
+
+  /*
+  operator<< text of one thread which isn't flushed yet. Registered once per thread, after that the thread reaches it
+  through a thread_local pointer. The lock is only contended while flush() walks over every thread.
+  */
+  struct PartialLine {
+    std::mutex lock;
+    std::string buffer;
+    StringAppendBuffer append_buffer{buffer};
+    std::ostream stream{&append_buffer};
+    Severity severity = Severity::DEBUG;
+    bool orphaned = false; // owning thread exited, flush() logs what's left and drops it
+
+    // new line starts with default formatting, same as a fresh stringstream
+    void reset() {
+      buffer.clear();
+      stream.flags(std::ios_base::skipws | std::ios_base::dec);
+      stream.precision(6);
+      stream.width(0);
+      stream.fill(' ');
+    }
+  };
+
+  // thread_local side, indexed by Logger::_instance_id
+  struct ThreadPartialLines {
+    std::vector<std::shared_ptr<PartialLine>> lines;
+    ~ThreadPartialLines() {
+      for (auto &line : lines) {
+        if (line) {
+          std::lock_guard<std::mutex> lock(line->lock);
+          line->orphaned = true;
+        }
+      }
+    }
+  };
+
+  static inline std::atomic<size_t> _instance_counter{0};
+  const size_t _instance_id = _instance_counter.fetch_add(1, std::memory_order_relaxed);
+
+  std::mutex _partial_lines_mutex;
+  std::vector<std::shared_ptr<PartialLine>> _partial_lines;
+
+  const std::string _name;
   std::string _log_filename;
-  std::ofstream _log_file_stream;
 
-  Severity _log_severity = Severity::DEBUG;
+  // settings of the file sink open() creates from OutputMode, rotation applies to both kinds of log file
+  LogRotation _log_rotation;
+  bool _memory_mapped = false;
+  size_t _segment_size = MappedLogFile::default_segment_size;
+
+  // fixed between open() and close(), log() reads it without a lock
+  std::vector<std::shared_ptr<LogSink>> _sinks;
+  // sinks came from OutputMode, close() drops them again
+  bool _default_sinks = false;
+  // CONSOLE mode logs before open() go here
+  std::shared_ptr<ConsoleSink> _console_sink = std::make_shared<ConsoleSink>();
+
+  std::atomic<Severity> _log_severity{Severity::DEBUG};
   OutputMode _log_output_mode = OutputMode::UBIQUITOUS;
 
   bool _log_file_open = false;
 
-  inline std::string get_severity_string(const Severity severity) {
-    std::string result{"NONE"};
-    const std::unordered_map<Severity, std::string> severity_string_map{{Severity::DEBUG, "DEBUG"},
-                                                                        {Severity::INFO, "INFO"},
-                                                                        {Severity::WARNING, "WARNING"},
-                                                                        {Severity::ERROR, "ERROR"}};
-    if (severity_string_map.count(severity))
-      result = severity_string_map.at(severity);
-    return result;
-  }
+  /*-----------------------async mode-----------------------*/
+  // finished log line (with new line) waiting for the writer thread
+  struct LogRecord {
+    std::string line;
+    Severity severity = Severity::DEBUG;
+  };
+
+  // max records taken off the queue at once, also the batch size of default sinks in async mode
+  static constexpr size_t _async_batch_size = 256;
+  // writer wakes up at least this often when idle, also the flush interval of default sinks in async mode
+  static constexpr std::chrono::milliseconds _async_idle_wait{10};
+
+  bool _async_enabled = false;
+  size_t _async_queue_capacity = 0;
+  OverflowPolicy _overflow_policy = OverflowPolicy::BLOCK;
+
+  std::unique_ptr<MPSCRingBuffer<LogRecord>> _async_queue;
+  // drains the async queue, and in both modes hands batched sink lines out once their flush interval passed
+  std::thread _writer_thread;
+  std::chrono::milliseconds _writer_tick{_async_idle_wait};
+  std::atomic<bool> _writer_running{false};
+  std::atomic<bool> _async_running{false};
+  std::atomic<bool> _writer_sleeping{false};
+  std::atomic<uint32_t> _flush_waiters{0};
+  std::atomic<uint64_t> _dropped_count{0};
+  std::mutex _writer_mutex;
+  std::condition_variable _writer_wakeup;
+  std::condition_variable _writer_progress;
 
   // default time stamp formate for log
   static std::string get_timestamp(void) {
-    auto now = std::chrono::system_clock::now();
-    auto now_time = std::chrono::system_clock::to_time_t(now);
-    auto in_milisecond = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-    std::tm tm = *std::localtime(&now_time);
-    std::ostringstream string_stream;
-    string_stream << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-    string_stream << '.' << std::setw(3) << std::setfill('0') << in_milisecond.count();
-    return string_stream.str();
+    char timestamp[LogPrefix::timestamp_size];
+    LogPrefix::write_timestamp(timestamp);
+    return std::string(timestamp, sizeof(timestamp));
   };
 
-  static std::string get_this_thread_id(void) {
-    std::ostringstream string_stream;
-    string_stream << std::dec << std::this_thread::get_id();
-    return string_stream.str();
-  };
+  static std::string get_this_thread_id(void) { return std::string(LogPrefix::this_thread_id()); };
+
+  template <typename Callback> static bool is_callback(const Callback &callback, std::string (*function)(void)) {
+    const auto target = callback.template target<std::string (*)(void)>();
+    return target && *target == function;
+  }
+
+  // "[timestamp] [thread id] [SEVERITY] ", no allocation unless custom callbacks are set
+  void append_prefix(std::string &line, Severity severity) {
+    char timestamp[LogPrefix::timestamp_size];
+    std::string custom_timestamp, custom_thread_id;
+    std::string_view timestamp_view, thread_id_view;
+    if (_default_timestamp) {
+      LogPrefix::write_timestamp(timestamp);
+      timestamp_view = std::string_view(timestamp, sizeof(timestamp));
+    } else {
+      custom_timestamp = _timestamp_callback();
+      timestamp_view = custom_timestamp;
+    }
+    if (_default_thread_id) {
+      thread_id_view = LogPrefix::this_thread_id();
+    } else {
+      custom_thread_id = _thread_id_callback();
+      thread_id_view = custom_thread_id;
+    }
+    LogPrefix::append(line, timestamp_view, thread_id_view, get_severity_string(severity));
+  }
 
   static std::string get_default_log_filename() {
     std::string filename = Logger::get_timestamp();
@@ -91,43 +216,244 @@ private:
     return filename + ".log";
   }
 
-  std::string place_in_bracket(std::string value) { return "[" + value + "]"; }
-
-  void flush() {
+  void flush_partials() {
     if (!_log_file_open) {
       return;
     }
 
     { // RAII scope for lock_guard
-      std::lock_guard<std::mutex> lock(_partial_log_mutext);
-      for (auto &pair_value : _partial_log_line_map) {
-        // log partial log and severity (it's mapped and iterate over thread_id)
-        log(pair_value.second.rdbuf(), _partial_log_line_severity_map[pair_value.first]);
+      std::lock_guard<std::mutex> lock(_partial_lines_mutex);
+      for (auto &line : _partial_lines) {
+        std::lock_guard<std::mutex> line_lock(line->lock);
+        if (!line->buffer.empty()) {
+          log(line->buffer, line->severity);
+          line->reset();
+        }
       }
-      _partial_log_line_map.clear();
-      _partial_log_line_severity_map.clear();
+      // forget buffers of threads which are gone
+      _partial_lines.erase(std::remove_if(_partial_lines.begin(), _partial_lines.end(),
+                                          [](const std::shared_ptr<PartialLine> &line) {
+                                            std::lock_guard<std::mutex> line_lock(line->lock);
+                                            return line->orphaned;
+                                          }),
+                           _partial_lines.end());
     }
-    _log_file_stream.flush();
   }
 
-  template <typename T> void add_partial(const T &part_of_log) {
-    { // RAII scope for lock_guard
-      std::lock_guard lock(_partial_log_mutext);
-      auto &partial_stream = _partial_log_line_map[_thread_id_callback()];
-      partial_stream << part_of_log;
+  // every sink filters and locks by itself
+  void write_line(std::string_view line, Severity severity) {
+    for (auto &sink : _sinks)
+      sink->write(line, severity);
+  }
+
+  // sinks OutputMode asks for, in async mode they batch like the writer thread does
+  void create_default_sinks() {
+    if (_log_output_mode >= OutputMode::FILE) {
+      if (_memory_mapped)
+        _sinks.push_back(std::make_shared<MappedFileSink>(_log_filename, _segment_size, _log_rotation));
+      else
+        _sinks.push_back(std::make_shared<FileSink>(_log_filename, _log_rotation));
+    }
+    if (_log_output_mode == OutputMode::CONSOLE || _log_output_mode == OutputMode::UBIQUITOUS)
+      _sinks.push_back(_console_sink);
+    for (auto &sink : _sinks) {
+      sink->set_batch_size(_async_enabled ? _async_batch_size : 1);
+      sink->set_flush_interval(_async_enabled ? _async_idle_wait : std::chrono::milliseconds(0));
     }
+    _default_sinks = true;
   }
 
-  void flush_partial() {
-    const std::string thread_id = _thread_id_callback();
+  void enqueue(LogRecord &record) {
+    while (!_async_queue->try_push(record)) {
+      // close() stopped the writer, nothing drains the queue anymore
+      if (!_async_running.load(std::memory_order_acquire)) {
+        write_line(record.line, record.severity);
+        return;
+      }
+      if (_overflow_policy == OverflowPolicy::DROP)
+        return;
+      if (_overflow_policy == OverflowPolicy::DROP_AND_COUNT) {
+        _dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      wake_writer();
+      std::this_thread::yield();
+    }
+    // pairs with the fence in writer_loop, either the writer sees the record or we see it going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_writer_sleeping.load(std::memory_order_relaxed))
+      wake_writer();
+  }
+
+  void wake_writer() {
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    _writer_wakeup.notify_one();
+  }
+
+  // the writer is needed in async mode or when some sink waits for its flush interval
+  void start_writer() {
+    _writer_tick = _async_idle_wait;
+    bool sinks_need_ticks = false;
+    for (auto &sink : _sinks) {
+      const auto interval = sink->get_flush_interval();
+      if (interval.count() && sink->get_batch_size() > 1) {
+        sinks_need_ticks = true;
+        _writer_tick = std::max(std::min(_writer_tick, interval), std::chrono::milliseconds(1));
+      }
+    }
+    if (!_async_enabled && !sinks_need_ticks)
+      return;
+
+    if (_async_enabled && (!_async_queue || _async_queue->capacity() < _async_queue_capacity))
+      _async_queue = std::make_unique<MPSCRingBuffer<LogRecord>>(_async_queue_capacity);
+    _writer_running.store(true, std::memory_order_release);
+    _async_running.store(_async_enabled, std::memory_order_release);
+    _writer_thread = std::thread(&Logger::writer_loop, this);
+  }
+
+  // drains everything that was queued before returning
+  void stop_writer() {
+    if (!_writer_thread.joinable())
+      return;
+    _async_running.store(false, std::memory_order_release);
+    _writer_running.store(false, std::memory_order_release);
+    wake_writer();
+    _writer_thread.join();
+    // records pushed by producers that saw the writer running after its last look at the queue
+    if (_async_queue) {
+      while (LogRecord *record = _async_queue->peek()) {
+        write_line(record->line, record->severity);
+        _async_queue->release(1);
+      }
+    }
+  }
+
+  // blocks until every record queued before the call has been written
+  void wait_for_writer() {
+    const size_t ticket = _async_queue->enqueue_position();
+    _flush_waiters.fetch_add(1, std::memory_order_acq_rel);
+    // pairs with the fence in writer_loop, either the writer sees this waiter or we see its dequeue position
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock(_writer_mutex);
+      _writer_wakeup.notify_one();
+      _writer_progress.wait(lock, [&] {
+        return _async_queue->dequeue_position() >= ticket || !_async_running.load(std::memory_order_acquire);
+      });
+    }
+    _flush_waiters.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  // background thread, hands queued records to the sinks and ticks their flush intervals
+  void writer_loop() {
+    uint64_t dropped_reported = 0;
+    std::string dropped_line;
+
+    for (;;) {
+      size_t count = 0;
+      if (_async_enabled) {
+        while (count < _async_batch_size) {
+          LogRecord *record = _async_queue->peek(count);
+          if (!record)
+            break;
+          write_line(record->line, record->severity);
+          ++count;
+        }
+      }
+
+      const uint64_t dropped = _dropped_count.load(std::memory_order_relaxed);
+      if (dropped != dropped_reported) {
+        format_line(dropped_line,
+                    std::to_string(dropped - dropped_reported) + " log records dropped, async queue full",
+                    Severity::WARNING);
+        dropped_reported = dropped;
+        write_line(dropped_line, Severity::WARNING);
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      for (auto &sink : _sinks)
+        sink->flush_if_due(now);
+
+      if (count) {
+        _async_queue->release(count);
+        // pairs with the fence in wait_for_writer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_flush_waiters.load(std::memory_order_relaxed)) {
+          std::lock_guard<std::mutex> lock(_writer_mutex);
+          _writer_progress.notify_all();
+        }
+        continue;
+      }
+
+      if (!_writer_running.load(std::memory_order_acquire))
+        break;
+
+      std::unique_lock<std::mutex> lock(_writer_mutex);
+      _writer_sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if ((!_async_enabled || !_async_queue->peek()) && _writer_running.load(std::memory_order_acquire))
+        _writer_wakeup.wait_for(lock, _writer_tick);
+      _writer_sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    _writer_progress.notify_all();
+  }
+
+  void format_line(std::string &line, std::string_view log_string, Severity severity) {
+    line.clear();
+    append_prefix(line, severity);
+    line.append(log_string);
+    line.push_back('\n');
+  }
+
+  // partial line of the calling thread, registers it on first use
+  PartialLine &this_thread_partial() {
+    static thread_local ThreadPartialLines thread_lines;
+    if (_instance_id < thread_lines.lines.size() && thread_lines.lines[_instance_id])
+      return *thread_lines.lines[_instance_id];
+
+    auto line = std::make_shared<PartialLine>();
     { // RAII scope for lock_guard
-      std::lock_guard lock(_partial_log_mutext);
-      log(_partial_log_line_map[thread_id].rdbuf(), _partial_log_line_severity_map[thread_id]);
+      std::lock_guard<std::mutex> lock(_partial_lines_mutex);
+      _partial_lines.push_back(line);
+    }
+    if (thread_lines.lines.size() <= _instance_id)
+      thread_lines.lines.resize(_instance_id + 1);
+    thread_lines.lines[_instance_id] = line;
+    return *line;
+  }
+
+  template <typename T> void add_partial(const T &part_of_log) {
+    PartialLine &line = this_thread_partial();
+    if (!is_enabled(line.severity))
+      return;
+    std::lock_guard<std::mutex> lock(line.lock);
+    line.stream << part_of_log;
+  }
 
-      // remove partial log buffer
-      _partial_log_line_map.erase(thread_id);
-      _partial_log_line_severity_map.erase(thread_id);
+  void add_partial_text(std::string_view log_data) {
+    if (log_data == Logger::endl) {
+      flush_partial();
+      return;
+    }
+    PartialLine &line = this_thread_partial();
+    if (!is_enabled(line.severity))
+      return;
+    { // RAII scope for lock_guard
+      std::lock_guard<std::mutex> lock(line.lock);
+      line.buffer.append(log_data);
     }
+    // if have new line flush it
+    if (!log_data.empty() && log_data.back() == '\n')
+      flush_partial();
+  }
+
+  void flush_partial() {
+    PartialLine &line = this_thread_partial();
+    std::lock_guard<std::mutex> lock(line.lock);
+    log(line.buffer, line.severity);
+    line.reset();
   }
 
 public:
@@ -138,12 +464,31 @@ public:
     return self;
   }
 
+  /*
+  Named logger, created on first use and alive until exit. Each one has its own sinks, severity, queue and writer
+  thread, a noisy component gets its own instance so it can't stall the others.
+  */
+  static Logger &get_instance(const std::string &name) {
+    static std::mutex instances_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<Logger, InstanceDeleter>> instances;
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto &instance = instances[name];
+    if (!instance)
+      instance.reset(new Logger(name));
+    return *instance;
+  }
+
 private:
-  Logger() {
+  explicit Logger(const std::string &name = "") : _name(name) {
     set_timestamp_callback(Logger::get_timestamp);
     set_thread_id_callback(Logger::get_this_thread_id);
   }
 
+  // named instances are owned by get_instance(name), the destructor stays private
+  struct InstanceDeleter {
+    void operator()(Logger *logger) const { delete logger; }
+  };
+
   // delete copy constructor and assignment
   Logger(const Logger &) = delete;
   Logger &operator=(const Logger &) = delete;
@@ -151,16 +496,87 @@ private:
   // -----------Meyer’s Singleton----------
 public:
   static constexpr const char *endl = "\n";
+  static constexpr size_t default_async_queue_capacity = 8192;
+
+  static constexpr std::string_view get_severity_string(const Severity severity) { return log_severity_name(severity); }
+
+  const std::string &get_name() const { return _name; }
+
   inline void set_timestamp_callback(type_timestamp_callback callback) {
-    if (!_log_file_open && callback)
+    if (!_log_file_open && callback) {
+      _default_timestamp = is_callback(callback, &Logger::get_timestamp);
       _timestamp_callback = callback;
+    }
   }
 
   inline void set_thread_id_callback(type_thread_id_callback callback) {
-    if (!_log_file_open && callback)
+    if (!_log_file_open && callback) {
+      _default_thread_id = is_callback(callback, &Logger::get_this_thread_id);
       _thread_id_callback = callback;
+    }
+  }
+
+  /*
+  Moves file/console writes to a background thread. log() only formats the line and pushes it into a bounded
+  lock-free queue, the writer thread batches whatever is queued into one writev per output.
+  Has to be called before open().
+  */
+  inline void set_async_mode(size_t queue_capacity = default_async_queue_capacity,
+                             OverflowPolicy overflow_policy = OverflowPolicy::BLOCK) {
+    if (_log_file_open || !queue_capacity)
+      return;
+    _async_enabled = true;
+    _async_queue_capacity = queue_capacity;
+    _overflow_policy = overflow_policy;
+  }
+
+  /*
+  Rotates the log file once it would grow past max_bytes and/or on every multiple of interval, the closed file
+  becomes "<filename>.1", "<filename>.2", ... Only the newest retention rotated files are kept, 0 keeps all.
+  Has to be called before open().
+  */
+  inline void set_rotation(size_t max_bytes, std::chrono::seconds interval = std::chrono::seconds(0),
+                           size_t retention = 0) {
+    if (_log_file_open)
+      return;
+    _log_rotation.max_bytes = max_bytes;
+    _log_rotation.interval = interval;
+    _log_rotation.retention = retention;
+  }
+
+  /*
+  Writes the log file through preallocated memory mapped segments (MappedLogFile), lines are copied into the mapping
+  without a lock or syscall. A full segment rotates like set_rotation's max_bytes.
+  Has to be called before open().
+  */
+  inline void set_memory_mapped(size_t segment_size = MappedLogFile::default_segment_size) {
+    if (_log_file_open || !segment_size)
+      return;
+    _memory_mapped = true;
+    _segment_size = segment_size;
   }
 
+  /*
+  Adds an output next to/instead of the ones OutputMode would create. Once a sink was added open() creates none
+  itself, the init() filename and OutputMode only matter for the default sinks. A sink can be shared by several
+  loggers, close() only flushes it, its owner closes it (or its destructor does). Has to be called before open().
+    auto errors = std::make_shared<common_util::FileSink>("errors.log", common_util::LogRotation{},
+                                                          common_util::Logger::Severity::ERROR, 64, 100ms);
+    logger.add_sink(errors);
+  */
+  inline void add_sink(std::shared_ptr<LogSink> sink) {
+    if (_log_file_open || !sink)
+      return;
+    if (_default_sinks) {
+      _sinks.clear();
+      _default_sinks = false;
+    }
+    _sinks.push_back(std::move(sink));
+  }
+
+  // records thrown away by OverflowPolicy::DROP_AND_COUNT so far
+  uint64_t get_dropped_count() const { return _dropped_count.load(std::memory_order_relaxed); }
+
   // do not use std::endl it flushes the whole buffer
 
   void init(const std::string &log_file_name = Logger::get_default_log_filename(),
@@ -175,70 +591,103 @@ public:
   void open() {
     if (_log_file_open)
       return;
-    _log_file_stream.open(_log_filename, std::ios::out);
-    _log_file_open = true;
-    if (!_log_file_open) {
-      throw std::runtime_error("Error in logfile Terminating ...." + _log_filename);
+    if (_sinks.empty()) {
+      try {
+        create_default_sinks();
+      } catch (const std::system_error &) {
+        _sinks.clear();
+        _default_sinks = false;
+        throw std::runtime_error("Error in logfile Terminating ...." + _log_filename);
+      }
     }
+    _log_file_open = true;
+    start_writer();
   }
 
+  /*
+  Pushes out pending partial lines and waits until everything logged before the call reached the file/console.
+  In async mode it's a barrier on the writer thread, afterwards every sink hands out what it batched.
+  */
+  void flush() {
+    flush_partials();
+    if (_async_running.load(std::memory_order_acquire))
+      wait_for_writer();
+    for (auto &sink : _sinks)
+      sink->flush();
+  }
+
+  // stop the writer thread (draining the queue), close the default sinks and flush added ones
   void close() {
     if (_log_file_open) {
-      _log_file_stream.flush();
-      _log_file_stream.close();
+      stop_writer();
+      for (auto &sink : _sinks) {
+        if (_default_sinks)
+          sink->close();
+        else
+          sink->flush();
+      }
+      if (_default_sinks) {
+        _sinks.clear();
+        _default_sinks = false;
+      }
     }
+    _console_sink->flush();
     _log_file_open = false;
   }
 
+  // compile time part of the severity filter, see COMMON_UTIL_LOG_LEVEL
+  static constexpr bool is_compiled_in(Severity severity) {
+    return static_cast<int>(severity) >= COMMON_UTIL_LOG_LEVEL;
+  }
+
+  // runtime part of the severity filter, cheap enough to run before any formatting
+  inline bool is_enabled(Severity severity) const {
+    return is_compiled_in(severity) && severity >= _log_severity.load(std::memory_order_relaxed);
+  }
+
+  inline void set_severity(Severity log_severity) { _log_severity.store(log_severity, std::memory_order_relaxed); }
+
   void log(const std::string &log_string, Severity severity) {
-    if (!_log_file_open && _log_output_mode >= OutputMode::FILE) {
-      std::cerr << "-------Log file not open---------";
+    if (!is_enabled(severity)) {
       return;
     }
 
-    if (severity < _log_severity) {
+    if (!_log_file_open && _log_output_mode >= OutputMode::FILE) {
+      std::cerr << "-------Log file not open---------";
       return;
     }
 
-    std::string log = place_in_bracket(_timestamp_callback()) + " " + place_in_bracket(_thread_id_callback()) + " " +
-                      place_in_bracket(get_severity_string(severity)) + " " + log_string;
-    std::lock_guard<std::mutex> lock(_logfile_mutex);
-    if (_log_output_mode >= OutputMode::FILE) {
-      // flush the streem after each log;
-      _log_file_stream << log << std::endl;
+    // reused by every line of this thread, in async mode the queue swaps buffers instead of freeing them
+    static thread_local LogRecord record;
+    format_line(record.line, log_string, severity);
+    record.severity = severity;
+    if (_async_running.load(std::memory_order_acquire)) {
+      enqueue(record);
+      return;
     }
-
-    if (_log_output_mode == OutputMode::CONSOLE || _log_output_mode == OutputMode::UBIQUITOUS) {
-      if (severity == Severity::ERROR || severity == Severity::WARNING) {
-        std::cerr << log << std::endl;
-      } else {
-        std::cout << log << std::endl;
-      }
+    if (!_log_file_open) {
+      _console_sink->write(record.line, severity);
+      return;
     }
+    write_line(record.line, severity);
   }
 
   template <typename T> void log(const T &value, Severity severity) {
+    if (!is_enabled(severity))
+      return;
     std::ostringstream string_stream;
     string_stream << value;
     log(string_stream.str(), severity);
   }
 
   inline Logger &operator<<(const std::string &log_data) {
-    if (log_data == Logger::endl) {
-      this->flush_partial();
-    } else {
-      this->add_partial(log_data);
-      // if have new line flush it
-      auto pos = log_data.rfind("\n");
-      if (pos != std::string::npos && pos == log_data.size() - 1)
-        this->flush_partial();
-    }
+    this->add_partial_text(log_data);
     return *this;
   }
 
   // Also take string litrals
   inline Logger &operator<<(const char *log_data) {
-    *this << std::string(log_data);
+    this->add_partial_text(log_data);
     return *this;
   }
 
@@ -248,12 +697,47 @@ public:
   }
 
   Logger &operator()(Severity log_severity) {
-    if (_partial_log_line_severity_map[_thread_id_callback()] != log_severity)
-      flush();
-
-    _partial_log_line_severity_map[_thread_id_callback()] = log_severity;
-    return get_instance();
+    PartialLine &line = this_thread_partial();
+    std::lock_guard<std::mutex> lock(line.lock);
+    // text collected under the previous severity goes out first
+    if (line.severity != log_severity && !line.buffer.empty()) {
+      log(line.buffer, line.severity);
+      line.reset();
+    }
+    line.severity = log_severity;
+    return *this;
   }
 };
 
-} // namespace common_util
\ No newline at end of file
+} // namespace common_util
+
+/*
+Severity filtered logging. Below COMMON_UTIL_LOG_LEVEL the call is compiled out, otherwise the runtime severity is
+checked before the message expression is evaluated. COMMON_UTIL_LOG and friends use the default instance.
+  COMMON_UTIL_LOG_DEBUG(common_util::string_format("book depth ", depth));
+  COMMON_UTIL_LOG_TO(common_util::Logger::get_instance("orders"), common_util::Logger::Severity::INFO, "filled");
+  COMMON_UTIL_LOG_STREAM(common_util::Logger::Severity::INFO) << "book depth " << depth << common_util::Logger::endl;
+*/
+#define COMMON_UTIL_LOG_TO(logger, log_severity, message)                                                          \
+  do {                                                                                                             \
+    if constexpr (::common_util::Logger::is_compiled_in(log_severity)) {                                           \
+      ::common_util::Logger &_cu_logger = (logger);                                                                \
+      if (_cu_logger.is_enabled(log_severity))                                                                     \
+        _cu_logger.log(message, log_severity);                                                                     \
+    }                                                                                                              \
+  } while (0)
+
+#define COMMON_UTIL_LOG(log_severity, message)                                                                     \
+  COMMON_UTIL_LOG_TO(::common_util::Logger::get_instance(), log_severity, message)
+
+#define COMMON_UTIL_LOG_DEBUG(message) COMMON_UTIL_LOG(::common_util::Logger::Severity::DEBUG, message)
+#define COMMON_UTIL_LOG_INFO(message) COMMON_UTIL_LOG(::common_util::Logger::Severity::INFO, message)
+#define COMMON_UTIL_LOG_WARNING(message) COMMON_UTIL_LOG(::common_util::Logger::Severity::WARNING, message)
+#define COMMON_UTIL_LOG_ERROR(message) COMMON_UTIL_LOG(::common_util::Logger::Severity::ERROR, message)
+
+// the if/else chain keeps a trailing "else" of the caller bound to the caller's own if
+#define COMMON_UTIL_LOG_STREAM(log_severity)                                                                       \
+  if constexpr (!::common_util::Logger::is_compiled_in(log_severity)) {                                            \
+  } else if (!::common_util::Logger::get_instance().is_enabled(log_severity)) {                                    \
+  } else                                                                                                           \
+    ::common_util::Logger::get_instance()(log_severity)
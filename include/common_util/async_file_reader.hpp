@@ -0,0 +1,521 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <ios>
+#include <iterator>
+#include <linux/io_uring.h>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace common_util {
+
+struct AsyncReadOptions {
+  enum class Backend {
+    AUTO,     // io_uring, pread threads if the kernel doesn't allow it
+    IO_URING, // throws std::system_error if io_uring isn't available
+    PREAD,    // pool of threads doing blocking pread
+  };
+
+  size_t block_size = 1 << 20; // bytes per read, rounded up to direct_alignment
+  size_t queue_depth = 32;     // reads in flight, at least 2 once the file has more than one block
+  bool direct = true;          // O_DIRECT, skips the page cache. Dropped if the file system refuses it
+  Backend backend = Backend::AUTO;
+};
+
+namespace async_read_detail {
+
+// O_DIRECT wants offset, length and buffer aligned to the logical block size, a page covers every device we use
+constexpr size_t direct_alignment = 4096;
+
+struct Completion {
+  uint64_t tag;
+  int64_t result; // bytes read or -errno
+};
+
+class ReadBackend {
+public:
+  virtual ~ReadBackend() = default;
+  // starts reading size bytes at offset into buffer, tag comes back with the completion
+  virtual void submit(int file, void *buffer, size_t size, uint64_t offset, uint64_t tag) = 0;
+  // blocks until one submitted read finished
+  virtual Completion wait() = 0;
+};
+
+/*
+io_uring through the raw syscalls, one IORING_OP_READV per block. The submission and completion rings are shared
+with the kernel, head and tail indices are read and written with acquire/release as the kernel's side does.
+*/
+class IoUringBackend final : public ReadBackend {
+public:
+  explicit IoUringBackend(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    _ring = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (_ring == -1)
+      throw std::system_error(errno, std::iostream_category(), "Can't set up io_uring");
+
+    _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+    _sq = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+    _cq = single_mmap ? _sq
+                      : mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring,
+                             IORING_OFF_CQ_RING);
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes =
+        mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES);
+    if (_sq == MAP_FAILED || _cq == MAP_FAILED || sqes == MAP_FAILED) {
+      const int error = errno;
+      release();
+      throw std::system_error(error, std::iostream_category(), "Can't map io_uring");
+    }
+    _sqes = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(_sq);
+    _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(_cq);
+    _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    _iovecs.resize(params.sq_entries);
+  }
+
+  ~IoUringBackend() override { release(); }
+
+  void submit(int file, void *buffer, size_t size, uint64_t offset, uint64_t tag) override {
+    const unsigned tail = *_sq_tail;
+    const unsigned index = tail & _sq_mask;
+    _iovecs[index] = {buffer, size};
+    io_uring_sqe &sqe = _sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<uint64_t>(&_iovecs[index]);
+    sqe.len = 1;
+    sqe.off = offset;
+    sqe.user_data = tag;
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    while (::syscall(__NR_io_uring_enter, _ring, 1, 0, 0, nullptr, 0) == -1) {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        throw std::system_error(errno, std::iostream_category(), "Can't submit to io_uring");
+    }
+  }
+
+  Completion wait() override {
+    const unsigned head = *_cq_head;
+    while (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+      if (::syscall(__NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == -1 && errno != EINTR)
+        throw std::system_error(errno, std::iostream_category(), "Can't wait for io_uring");
+    }
+    const io_uring_cqe &cqe = _cqes[head & _cq_mask];
+    const Completion completion{cqe.user_data, cqe.res};
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    return completion;
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  IoUringBackend(const IoUringBackend &) = delete;
+  IoUringBackend &operator=(const IoUringBackend &) = delete;
+  IoUringBackend(IoUringBackend &&) = delete;
+  IoUringBackend &operator=(IoUringBackend &&) = delete;
+
+private:
+  void release() {
+    if (_sqes)
+      munmap(_sqes, _sqes_size);
+    if (_cq && _cq != MAP_FAILED && _cq != _sq)
+      munmap(_cq, _cq_size);
+    if (_sq && _sq != MAP_FAILED)
+      munmap(_sq, _sq_size);
+    if (_ring != -1)
+      ::close(_ring);
+    _sqes = nullptr;
+    _sq = _cq = nullptr;
+    _ring = -1;
+  }
+
+  int _ring = -1;
+  void *_sq = nullptr;
+  void *_cq = nullptr;
+  size_t _sq_size = 0;
+  size_t _cq_size = 0;
+  size_t _sqes_size = 0;
+  io_uring_sqe *_sqes = nullptr;
+  unsigned *_sq_tail = nullptr;
+  unsigned *_sq_array = nullptr;
+  unsigned _sq_mask = 0;
+  unsigned *_cq_head = nullptr;
+  unsigned *_cq_tail = nullptr;
+  unsigned _cq_mask = 0;
+  io_uring_cqe *_cqes = nullptr;
+  std::vector<iovec> _iovecs; // READV reads the iovec at submission, one per ring slot
+};
+
+// blocking pread on a pool of threads, as many reads in flight as there are threads
+class PreadBackend final : public ReadBackend {
+  struct Request {
+    int file;
+    void *buffer;
+    size_t size;
+    uint64_t offset;
+    uint64_t tag;
+  };
+
+public:
+  explicit PreadBackend(size_t threads) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+      _workers.emplace_back(&PreadBackend::worker_loop, this);
+  }
+
+  ~PreadBackend() override {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _requested.notify_all();
+    for (auto &worker : _workers)
+      worker.join();
+  }
+
+  void submit(int file, void *buffer, size_t size, uint64_t offset, uint64_t tag) override {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _requests.push_back({file, buffer, size, offset, tag});
+    }
+    _requested.notify_one();
+  }
+
+  Completion wait() override {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _completed.wait(lock, [&] { return !_completions.empty(); });
+    const Completion completion = _completions.front();
+    _completions.pop_front();
+    return completion;
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  PreadBackend(const PreadBackend &) = delete;
+  PreadBackend &operator=(const PreadBackend &) = delete;
+  PreadBackend(PreadBackend &&) = delete;
+  PreadBackend &operator=(PreadBackend &&) = delete;
+
+private:
+  void worker_loop() {
+    for (;;) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _requested.wait(lock, [&] { return _stopping || !_requests.empty(); });
+        if (_requests.empty())
+          return;
+        request = _requests.front();
+        _requests.pop_front();
+      }
+      // a whole block, unless the file ends
+      size_t done = 0;
+      int64_t result = 0;
+      while (done < request.size) {
+        const ssize_t read = ::pread(request.file, static_cast<char *>(request.buffer) + done, request.size - done,
+                                     static_cast<off_t>(request.offset + done));
+        if (read == -1 && errno == EINTR)
+          continue;
+        if (read <= 0) {
+          result = read == -1 ? -errno : 0;
+          break;
+        }
+        done += static_cast<size_t>(read);
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _completions.push_back({request.tag, result < 0 ? result : static_cast<int64_t>(done)});
+      }
+      _completed.notify_one();
+    }
+  }
+
+  std::vector<std::thread> _workers;
+  std::deque<Request> _requests;
+  std::deque<Completion> _completions;
+  bool _stopping = false;
+  std::mutex _mutex;
+  std::condition_variable _requested;
+  std::condition_variable _completed;
+};
+
+} // namespace async_read_detail
+
+/*
+Sequential record reader that keeps queue_depth block reads in flight, for cold files on NVMe where mmap page faults
+read at queue depth 1. Same iteration style as SMemoryMapped: next(), next_batch() or a range-for loop.
+Blocks are read with O_DIRECT into aligned buffers through io_uring (raw syscalls, no liburing) or, where io_uring is
+not available, a pool of pread threads. A buffer is handed back to the kernel for the next read as soon as the cursor
+leaves it. A record crossing a block boundary is stitched together in front of the following block, so records are
+always contiguous in memory.
+  common_util::AsyncFileReader<Trade> trades("trades.bin");
+  for (const Trade &trade : trades)
+    process(trade);
+*/
+template <typename T> class AsyncFileReader final {
+  static_assert(std::is_trivially_copyable_v<T>, "AsyncFileReader reads raw bytes of T");
+  using Backend = AsyncReadOptions::Backend;
+
+  struct Block {
+    char *data = nullptr;  // direct_alignment aligned, _prefix_bytes free in front for a stitched record
+    uint64_t index = 0;    // block number in the file
+    bool in_flight = false;
+    int64_t result = 0;
+  };
+
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    iterator() = default;
+    explicit iterator(AsyncFileReader *reader) : _reader(reader), _record(reader->next()) {}
+    reference operator*() const { return *_record; }
+    pointer operator->() const { return _record; }
+    iterator &operator++() {
+      _record = _reader->next();
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return _record == other._record; }
+    bool operator!=(const iterator &other) const { return _record != other._record; }
+
+  private:
+    AsyncFileReader *_reader = nullptr;
+    const T *_record = nullptr;
+  };
+
+  AsyncFileReader(const std::filesystem::path &path, const AsyncReadOptions &options = {}) : filePath(path) {
+    const size_t alignment = async_read_detail::direct_alignment;
+    _direct = options.direct;
+    file = _direct ? open(filePath.c_str(), O_RDONLY | O_DIRECT) : -1;
+    if (file == -1) {
+      // tmpfs and some others reject O_DIRECT
+      _direct = false;
+      file = open(filePath.c_str(), O_RDONLY);
+    }
+    if (file == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Can't open file to read :- ");
+    }
+    struct stat sb;
+    if (fstat(file, &sb) == -1) {
+      const int error = errno;
+      ::close(file);
+      throw std::system_error(error, std::iostream_category(), "Can't get size of file");
+    }
+    _file_size = sb.st_size;
+    _size = _file_size / sizeof(T);
+    _block_size = std::max(alignment, (options.block_size + alignment - 1) / alignment * alignment);
+    _prefix_bytes = (sizeof(T) + alignment - 1) / alignment * alignment;
+    _block_count = (_file_size + _block_size - 1) / _block_size;
+
+    // the block handed out is resubmitted only after the next one is loaded, more than one block needs two buffers
+    const size_t least = _block_count > 1 ? 2 : 1;
+    const size_t depth = std::max<size_t>(least, std::min<uint64_t>(options.queue_depth, _block_count));
+    try {
+      create_backend(options.backend, depth);
+      _buffers.reset(static_cast<char *>(std::aligned_alloc(alignment, depth * (_prefix_bytes + _block_size))));
+      if (!_buffers)
+        throw std::system_error(ENOMEM, std::iostream_category(), "Can't allocate read buffers");
+    } catch (...) {
+      ::close(file);
+      throw;
+    }
+    _blocks.resize(depth);
+    for (size_t i = 0; i < depth; ++i) {
+      _blocks[i].data = _buffers.get() + i * (_prefix_bytes + _block_size) + _prefix_bytes;
+      if (i < _block_count)
+        submit(_blocks[i], i);
+    }
+  }
+
+  // records in the file
+  size_t size() const { return _size; }
+  // records handed out so far
+  size_t position() const { return _position; }
+  // backend in use, AUTO resolved to IO_URING or PREAD
+  Backend backend() const { return _backend_kind; }
+  // false if the file system refused O_DIRECT
+  bool direct() const { return _direct; }
+
+  // Next record, nullptr at the end of the file. The pointer stays valid until the next call of next() or next_batch().
+  const T *next() {
+    if (!_batch_left && !load_batch())
+      return nullptr;
+    --_batch_left;
+    ++_position;
+    return _batch++;
+  }
+
+  /*
+  Up to max_records following records, contiguous in memory. Fewer are returned at the end of a block, an empty batch
+  means end of file. Valid until the next call of next() or next_batch().
+  */
+  std::pair<const T *, size_t> next_batch(size_t max_records = static_cast<size_t>(-1)) {
+    if (!_batch_left && !load_batch())
+      return {nullptr, 0};
+    const size_t count = std::min(max_records, _batch_left);
+    const T *batch = _batch;
+    _batch += count;
+    _batch_left -= count;
+    _position += count;
+    return {batch, count};
+  }
+
+  // reads from the current position on, a reader can be iterated once
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+  ~AsyncFileReader() {
+    // the kernel may still write into the buffers, wait for every read before freeing them
+    for (auto &block : _blocks)
+      while (block.in_flight)
+        complete(_backend->wait());
+    _backend.reset();
+    if (file != -1) {
+      ::close(file);
+    }
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  AsyncFileReader(const AsyncFileReader &) = delete;
+  AsyncFileReader &operator=(const AsyncFileReader &) = delete;
+  AsyncFileReader(AsyncFileReader &&) = delete;
+  AsyncFileReader &operator=(AsyncFileReader &&) = delete;
+
+private:
+  struct FreeDeleter {
+    void operator()(char *buffer) const { std::free(buffer); }
+  };
+
+  void create_backend(Backend backend, size_t depth) {
+    if (backend != Backend::PREAD) {
+      try {
+        _backend = std::make_unique<async_read_detail::IoUringBackend>(static_cast<unsigned>(depth));
+        _backend_kind = Backend::IO_URING;
+        return;
+      } catch (const std::system_error &) {
+        if (backend == Backend::IO_URING)
+          throw;
+      }
+    }
+    _backend = std::make_unique<async_read_detail::PreadBackend>(depth);
+    _backend_kind = Backend::PREAD;
+  }
+
+  void submit(Block &block, uint64_t index) {
+    block.index = index;
+    block.in_flight = true;
+    _backend->submit(file, block.data, _block_size, index * _block_size, static_cast<uint64_t>(&block - &_blocks[0]));
+  }
+
+  void complete(const async_read_detail::Completion &completion) {
+    Block &block = _blocks[completion.tag];
+    block.result = completion.result;
+    block.in_flight = false;
+  }
+
+  /*
+  A read may return less than asked for before the end of the file, the rest is read synchronously. O_DIRECT wants
+  the retry aligned, it starts again at the last alignment boundary below what was read.
+  */
+  void fill_short_read(Block &block) {
+    const uint64_t offset = block.index * _block_size;
+    const size_t expected = static_cast<size_t>(std::min<uint64_t>(_block_size, _file_size - offset));
+    const size_t alignment = _direct ? async_read_detail::direct_alignment : 1;
+    size_t done = static_cast<size_t>(block.result);
+    while (done < expected) {
+      const size_t from = done / alignment * alignment;
+      const ssize_t read = ::pread(file, block.data + from, _block_size - from, static_cast<off_t>(offset + from));
+      if (read == -1 && errno == EINTR)
+        continue;
+      if (read <= 0 || from + static_cast<size_t>(read) <= done)
+        throw std::system_error(read == -1 ? errno : EIO, std::iostream_category(), "Can't read file block");
+      done = from + static_cast<size_t>(read);
+    }
+    block.result = static_cast<int64_t>(done);
+  }
+
+  // records of the next block, together with a record stitched from the end of the previous one
+  bool load_batch() {
+    if (_position >= _size || _current >= _block_count)
+      return false;
+    Block &block = _blocks[_current % _blocks.size()];
+    while (block.in_flight)
+      complete(_backend->wait());
+    if (block.result < 0)
+      throw std::system_error(static_cast<int>(-block.result), std::iostream_category(), "Can't read file block");
+    fill_short_read(block);
+
+    // bytes of a record that started in the previous block go right in front of this one
+    std::memcpy(block.data - _carry_size, _carry, _carry_size);
+    const char *begin = block.data - _carry_size;
+    const size_t bytes = _carry_size + static_cast<size_t>(block.result);
+    const size_t records = std::min(bytes / sizeof(T), _size - _position);
+    _carry_size = bytes - records * sizeof(T);
+    std::memcpy(_carry, begin + records * sizeof(T), _carry_size);
+
+    // the previous block's buffer is free now, the records of this one stay valid until the next load
+    if (_current > 0) {
+      const uint64_t previous = _current - 1;
+      const uint64_t following = previous + _blocks.size();
+      if (following < _block_count)
+        submit(_blocks[previous % _blocks.size()], following);
+    }
+    ++_current;
+    _batch = reinterpret_cast<const T *>(begin);
+    _batch_left = records;
+    return records != 0 || load_batch();
+  }
+
+  std::filesystem::path filePath;
+  int file = -1;
+  bool _direct = true;
+  size_t _file_size = 0;     // bytes
+  size_t _size = 0;          // records
+  size_t _block_size = 0;    // bytes per read
+  size_t _prefix_bytes = 0;  // room for a stitched record in front of every block
+  uint64_t _block_count = 0; // blocks in the file
+  uint64_t _current = 0;     // next block to hand out
+  size_t _position = 0;      // records handed out
+  Backend _backend_kind = Backend::AUTO;
+  std::unique_ptr<async_read_detail::ReadBackend> _backend;
+  std::unique_ptr<char[], FreeDeleter> _buffers;
+  std::vector<Block> _blocks;
+  alignas(T) char _carry[sizeof(T)];
+  size_t _carry_size = 0;
+  const T *_batch = nullptr;
+  size_t _batch_left = 0;
+};
+
+} // namespace common_util
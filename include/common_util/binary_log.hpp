@@ -0,0 +1,593 @@
+#pragma once
+#include "Logger.hpp"
+#include "log_file.hpp"
+#include "log_prefix.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+Deferred formatting log for high rate tracing.
+The hot thread only copies a call site id, a timestamp and the raw bytes of the arguments into a per thread buffer.
+Nothing gets formatted until the file is turned back into text by BinaryLogDecoder (log_decode tool).
+
+  common_util::BinaryLogSink trace("trace.blog");
+  COMMON_UTIL_BINARY_LOG(trace, common_util::Logger::Severity::INFO, "fill {} qty {} at {}", symbol, qty, price);
+
+The format string must be a literal, every "{}" takes the next argument. Supported arguments are arithmetic types,
+const char *, std::string and std::string_view.
+
+File layout (native byte order, checked through the header):
+  header  : "CUBLOG01" magic, uint32 0x01020304 byte order mark
+  records : uint8 tag followed by
+    SITE   : uint32 site id, uint8 severity, uint32 line, uint16 argument count, uint8 argument types[count],
+             uint32 length + format, uint32 length + file
+    THREAD : uint32 thread index, uint32 length + thread id text
+    CHUNK  : uint32 thread index, uint32 byte count, events of that thread
+  event   : uint32 site id, int64 nanoseconds since epoch, arguments (fixed width, strings as uint32 length + bytes)
+*/
+namespace common_util {
+
+enum class BinaryLogArgType : uint8_t {
+  BOOL,
+  CHAR,
+  INT16,
+  INT32,
+  INT64,
+  UINT16,
+  UINT32,
+  UINT64,
+  FLOAT,
+  DOUBLE,
+  STRING,
+};
+
+template <typename T> constexpr BinaryLogArgType binary_log_arg_type() {
+  using Type = std::remove_cv_t<T>;
+  if constexpr (std::is_same_v<Type, bool>) {
+    return BinaryLogArgType::BOOL;
+  } else if constexpr (std::is_same_v<Type, char> || std::is_same_v<Type, signed char> ||
+                       std::is_same_v<Type, unsigned char>) {
+    // operator<< prints all char flavours as characters
+    return BinaryLogArgType::CHAR;
+  } else if constexpr (std::is_integral_v<Type>) {
+    static_assert(sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "unsupported integer width");
+    if constexpr (std::is_signed_v<Type>)
+      return sizeof(Type) == 2 ? BinaryLogArgType::INT16
+                               : (sizeof(Type) == 4 ? BinaryLogArgType::INT32 : BinaryLogArgType::INT64);
+    else
+      return sizeof(Type) == 2 ? BinaryLogArgType::UINT16
+                               : (sizeof(Type) == 4 ? BinaryLogArgType::UINT32 : BinaryLogArgType::UINT64);
+  } else if constexpr (std::is_same_v<Type, float>) {
+    return BinaryLogArgType::FLOAT;
+  } else if constexpr (std::is_same_v<Type, double>) {
+    return BinaryLogArgType::DOUBLE;
+  } else {
+    static_assert(std::is_same_v<Type, char *> || std::is_same_v<Type, const char *> ||
+                      std::is_same_v<Type, std::string> || std::is_same_v<Type, std::string_view>,
+                  "binary log arguments must be arithmetic or strings");
+    return BinaryLogArgType::STRING;
+  }
+}
+
+// compile time list of argument types of a call site
+template <typename... Args> struct BinaryLogArgList {
+  static constexpr uint16_t count = sizeof...(Args);
+  // one extra entry so the array isn't empty for sites without arguments
+  static constexpr BinaryLogArgType types[sizeof...(Args) + 1] = {binary_log_arg_type<Args>()...,
+                                                                  BinaryLogArgType::BOOL};
+};
+
+// only used inside decltype, gives the decayed argument types after the format of a macro call without evaluating it
+template <typename... Args>
+BinaryLogArgList<std::decay_t<Args>...> binary_log_arg_list(const char *format, const Args &...);
+
+// drops the format the macro passes along with the arguments
+template <typename Sink, typename... Args>
+inline void binary_log_write(Sink &sink, uint32_t site_id, const char *, const Args &...args) {
+  sink.write(site_id, args...);
+}
+
+constexpr size_t binary_log_placeholder_count(const char *format) {
+  size_t count = 0;
+  for (; *format; ++format) {
+    if (format[0] == '{' && format[1] == '}') {
+      ++count;
+      ++format;
+    }
+  }
+  return count;
+}
+
+// static description of one COMMON_UTIL_BINARY_LOG call site
+struct BinaryLogSite {
+  const char *format;
+  const char *file;
+  uint32_t line;
+  Logger::Severity severity;
+  const BinaryLogArgType *arg_types;
+  uint16_t arg_count;
+
+  // process wide site table, ids are indexes into it
+  static uint32_t register_site(const BinaryLogSite *site) {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    registry().push_back(site);
+    return static_cast<uint32_t>(registry().size() - 1);
+  }
+
+  // sites with id >= first, in id order
+  static std::vector<const BinaryLogSite *> registered_since(size_t first) {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    if (first >= registry().size())
+      return {};
+    return std::vector<const BinaryLogSite *>(registry().begin() + first, registry().end());
+  }
+
+private:
+  static std::vector<const BinaryLogSite *> &registry() {
+    static std::vector<const BinaryLogSite *> sites;
+    return sites;
+  }
+  static std::mutex &registry_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+};
+
+/*
+Sites below COMMON_UTIL_LOG_LEVEL are compiled out, same as COMMON_UTIL_LOG. The format travels in __VA_ARGS__ so a call
+without arguments doesn't need GNU ##__VA_ARGS__, the extra 0 keeps the variadic part of the _FORMAT helper non empty.
+*/
+#define COMMON_UTIL_BINARY_LOG_FORMAT(format, ...) format
+#define COMMON_UTIL_BINARY_LOG(sink, log_severity, ...)                                                            \
+  do {                                                                                                             \
+    using _cu_arg_list = decltype(::common_util::binary_log_arg_list(__VA_ARGS__));                                \
+    static constexpr const char *_cu_format = COMMON_UTIL_BINARY_LOG_FORMAT(__VA_ARGS__, 0);                       \
+    static_assert(::common_util::binary_log_placeholder_count(_cu_format) == _cu_arg_list::count,                  \
+                  "number of {} in the format doesn't match the arguments");                                       \
+    if constexpr (::common_util::Logger::is_compiled_in(log_severity)) {                                           \
+      static constexpr ::common_util::BinaryLogSite _cu_site{_cu_format,   __FILE__,            __LINE__,          \
+                                                             log_severity, _cu_arg_list::types, _cu_arg_list::count}; \
+      static const uint32_t _cu_site_id = ::common_util::BinaryLogSite::register_site(&_cu_site);                  \
+      if ((sink).is_enabled(log_severity))                                                                         \
+        ::common_util::binary_log_write((sink), _cu_site_id, __VA_ARGS__);                                         \
+    }                                                                                                              \
+  } while (0)
+
+namespace binary_log_detail {
+
+enum RecordTag : uint8_t {
+  SITE = 1,
+  THREAD = 2,
+  CHUNK = 3,
+};
+
+constexpr char magic[8] = {'C', 'U', 'B', 'L', 'O', 'G', '0', '1'};
+constexpr uint32_t byte_order_mark = 0x01020304;
+
+template <typename T> inline void put(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+inline void put_text(std::string &out, std::string_view text) {
+  put(out, static_cast<uint32_t>(text.size()));
+  out.append(text);
+}
+
+template <typename T> inline size_t encoded_size(const T &value) {
+  if constexpr (binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::STRING)
+    return sizeof(uint32_t) + std::string_view(value).size();
+  else if constexpr (binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::BOOL ||
+                     binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::CHAR)
+    return 1;
+  else
+    return sizeof(T);
+}
+
+template <typename T> inline char *encode(char *out, const T &value) {
+  if constexpr (binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::STRING) {
+    const std::string_view text(value);
+    const auto size = static_cast<uint32_t>(text.size());
+    std::memcpy(out, &size, sizeof(size));
+    std::memcpy(out + sizeof(size), text.data(), text.size());
+    return out + sizeof(size) + text.size();
+  } else if constexpr (binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::BOOL ||
+                       binary_log_arg_type<std::decay_t<T>>() == BinaryLogArgType::CHAR) {
+    *out = static_cast<char>(value);
+    return out + 1;
+  } else {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+  }
+}
+
+} // namespace binary_log_detail
+
+class BinaryLogSink final {
+  // events of one thread waiting to be written as a CHUNK
+  struct ThreadBuffer {
+    std::mutex lock; // only contended while flush() walks over every thread
+    std::vector<char> data;
+    size_t used = 0;
+    uint32_t thread_index = 0;
+    bool orphaned = false; // owning thread exited, flush() writes what's left and drops it
+  };
+
+  // thread_local side, indexed by BinaryLogSink::_instance_id
+  struct ThreadBuffers {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    ~ThreadBuffers() {
+      for (auto &buffer : buffers) {
+        if (buffer) {
+          std::lock_guard<std::mutex> lock(buffer->lock);
+          buffer->orphaned = true;
+        }
+      }
+    }
+  };
+
+public:
+  static constexpr size_t default_thread_buffer_size = 64 * 1024;
+
+  explicit BinaryLogSink(const std::string &filename, Logger::Severity severity = Logger::Severity::DEBUG,
+                         size_t thread_buffer_size = default_thread_buffer_size)
+      : _severity(severity), _thread_buffer_size(thread_buffer_size) {
+    _file.open(filename);
+    std::string header(binary_log_detail::magic, sizeof(binary_log_detail::magic));
+    binary_log_detail::put(header, binary_log_detail::byte_order_mark);
+    _file.write(header);
+  }
+
+  ~BinaryLogSink() { close(); }
+
+  bool is_enabled(Logger::Severity severity) const { return Logger::is_compiled_in(severity) && severity >= _severity; }
+
+  // hot path, called by COMMON_UTIL_BINARY_LOG
+  template <typename... Args> void write(uint32_t site_id, const Args &...args) {
+    const size_t size = sizeof(uint32_t) + sizeof(int64_t) + (size_t{0} + ... + binary_log_detail::encoded_size(args));
+    const int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+    ThreadBuffer &buffer = this_thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.lock);
+    if (buffer.used + size > buffer.data.size()) {
+      write_chunk(buffer);
+      if (size > buffer.data.size())
+        buffer.data.resize(size);
+    }
+    char *out = buffer.data.data() + buffer.used;
+    std::memcpy(out, &site_id, sizeof(site_id));
+    std::memcpy(out + sizeof(site_id), &timestamp, sizeof(timestamp));
+    out += sizeof(site_id) + sizeof(timestamp);
+    ((out = binary_log_detail::encode(out, args)), ...);
+    buffer.used += size;
+  }
+
+  // writes every thread's pending events
+  void flush() {
+    std::lock_guard<std::mutex> lock(_buffers_mutex);
+    for (auto &buffer : _buffers) {
+      std::lock_guard<std::mutex> buffer_lock(buffer->lock);
+      write_chunk(*buffer);
+    }
+    _buffers.erase(std::remove_if(_buffers.begin(), _buffers.end(),
+                                  [](const std::shared_ptr<ThreadBuffer> &buffer) {
+                                    std::lock_guard<std::mutex> buffer_lock(buffer->lock);
+                                    return buffer->orphaned;
+                                  }),
+                   _buffers.end());
+  }
+
+  void close() {
+    if (!_file.is_open())
+      return;
+    flush();
+    _file.close();
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  BinaryLogSink(const BinaryLogSink &) = delete;
+  BinaryLogSink &operator=(const BinaryLogSink &) = delete;
+  BinaryLogSink(BinaryLogSink &&) = delete;
+  BinaryLogSink &operator=(BinaryLogSink &&) = delete;
+
+private:
+  ThreadBuffer &this_thread_buffer() {
+    static thread_local ThreadBuffers thread_buffers;
+    if (_instance_id < thread_buffers.buffers.size() && thread_buffers.buffers[_instance_id])
+      return *thread_buffers.buffers[_instance_id];
+
+    static std::atomic<uint32_t> thread_counter{0};
+    static thread_local const uint32_t thread_index = thread_counter.fetch_add(1, std::memory_order_relaxed);
+
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->data.resize(_thread_buffer_size);
+    buffer->thread_index = thread_index;
+    { // RAII scope for lock_guard
+      std::lock_guard<std::mutex> lock(_buffers_mutex);
+      _buffers.push_back(buffer);
+      std::string record;
+      binary_log_detail::put(record, binary_log_detail::THREAD);
+      binary_log_detail::put(record, thread_index);
+      binary_log_detail::put_text(record, LogPrefix::this_thread_id());
+      write_records(record);
+    }
+    if (thread_buffers.buffers.size() <= _instance_id)
+      thread_buffers.buffers.resize(_instance_id + 1);
+    thread_buffers.buffers[_instance_id] = buffer;
+    return *buffer;
+  }
+
+  // buffer lock held by the caller
+  void write_chunk(ThreadBuffer &buffer) {
+    if (!buffer.used)
+      return;
+    std::string header;
+    binary_log_detail::put(header, binary_log_detail::CHUNK);
+    binary_log_detail::put(header, buffer.thread_index);
+    binary_log_detail::put(header, static_cast<uint32_t>(buffer.used));
+    std::lock_guard<std::mutex> lock(_file_mutex);
+    write_new_sites();
+    struct iovec iov[2] = {{header.data(), header.size()}, {buffer.data.data(), buffer.used}};
+    _file.writev(iov, 2);
+    buffer.used = 0;
+  }
+
+  void write_records(const std::string &records) {
+    std::lock_guard<std::mutex> lock(_file_mutex);
+    _file.write(records);
+  }
+
+  // site definitions always go out before the first chunk that can refer to them, _file_mutex held
+  void write_new_sites() {
+    const auto sites = BinaryLogSite::registered_since(_sites_written);
+    if (sites.empty())
+      return;
+    std::string records;
+    for (const BinaryLogSite *site : sites) {
+      binary_log_detail::put(records, binary_log_detail::SITE);
+      binary_log_detail::put(records, static_cast<uint32_t>(_sites_written++));
+      binary_log_detail::put(records, static_cast<uint8_t>(site->severity));
+      binary_log_detail::put(records, site->line);
+      binary_log_detail::put(records, site->arg_count);
+      records.append(reinterpret_cast<const char *>(site->arg_types), site->arg_count);
+      binary_log_detail::put_text(records, site->format);
+      binary_log_detail::put_text(records, site->file);
+    }
+    _file.write(records);
+  }
+
+  static inline std::atomic<size_t> _instance_counter{0};
+  const size_t _instance_id = _instance_counter.fetch_add(1, std::memory_order_relaxed);
+
+  const Logger::Severity _severity;
+  const size_t _thread_buffer_size;
+
+  std::mutex _file_mutex;
+  LogFile _file;
+  size_t _sites_written = 0;
+
+  std::mutex _buffers_mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+};
+
+/*
+Turns a binary log back into the text Logger writes: "[timestamp] [thread id] [SEVERITY] message".
+Events are printed in timestamp order across threads.
+*/
+class BinaryLogDecoder final {
+public:
+  BinaryLogDecoder(const char *data, size_t size) : _data(data), _size(size) {}
+
+  void decode(std::ostream &out) {
+    parse();
+    std::stable_sort(_events.begin(), _events.end(),
+                     [](const Event &first, const Event &second) { return first.timestamp < second.timestamp; });
+    std::string line;
+    for (const Event &event : _events) {
+      format_event(event, line);
+      out.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+  }
+
+private:
+  struct Site {
+    Logger::Severity severity = Logger::Severity::DEBUG;
+    std::vector<BinaryLogArgType> arg_types;
+    std::string format;
+    bool defined = false;
+  };
+
+  struct Event {
+    int64_t timestamp;
+    uint32_t site_id;
+    uint32_t thread_index;
+    size_t args_offset;
+  };
+
+  template <typename T> T read(size_t &offset) {
+    if (offset + sizeof(T) > _size)
+      throw std::runtime_error("Truncated binary log");
+    T value;
+    std::memcpy(&value, _data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+  }
+
+  std::string_view read_text(size_t &offset) {
+    const auto size = read<uint32_t>(offset);
+    if (offset + size > _size)
+      throw std::runtime_error("Truncated binary log");
+    std::string_view text(_data + offset, size);
+    offset += size;
+    return text;
+  }
+
+  size_t arg_size(BinaryLogArgType type, size_t offset) {
+    switch (type) {
+    case BinaryLogArgType::BOOL:
+    case BinaryLogArgType::CHAR:
+      return 1;
+    case BinaryLogArgType::INT16:
+    case BinaryLogArgType::UINT16:
+      return 2;
+    case BinaryLogArgType::INT32:
+    case BinaryLogArgType::UINT32:
+    case BinaryLogArgType::FLOAT:
+      return 4;
+    case BinaryLogArgType::INT64:
+    case BinaryLogArgType::UINT64:
+    case BinaryLogArgType::DOUBLE:
+      return 8;
+    case BinaryLogArgType::STRING:
+      return sizeof(uint32_t) + read<uint32_t>(offset);
+    }
+    throw std::runtime_error("Unknown argument type in binary log");
+  }
+
+  void parse() {
+    size_t offset = 0;
+    if (_size < sizeof(binary_log_detail::magic) + sizeof(uint32_t) ||
+        std::memcmp(_data, binary_log_detail::magic, sizeof(binary_log_detail::magic)) != 0)
+      throw std::runtime_error("Not a binary log");
+    offset += sizeof(binary_log_detail::magic);
+    if (read<uint32_t>(offset) != binary_log_detail::byte_order_mark)
+      throw std::runtime_error("Binary log was written with a different byte order");
+
+    // sites are needed to find event boundaries, chunks get walked once all records are known
+    std::vector<std::pair<size_t, size_t>> chunks;
+    std::vector<uint32_t> chunk_threads;
+    while (offset < _size) {
+      const auto tag = read<uint8_t>(offset);
+      if (tag == binary_log_detail::SITE) {
+        const auto id = read<uint32_t>(offset);
+        if (_sites.size() <= id)
+          _sites.resize(id + 1);
+        Site &site = _sites[id];
+        site.severity = static_cast<Logger::Severity>(read<uint8_t>(offset));
+        read<uint32_t>(offset); // line
+        const auto arg_count = read<uint16_t>(offset);
+        for (uint16_t i = 0; i < arg_count; ++i)
+          site.arg_types.push_back(static_cast<BinaryLogArgType>(read<uint8_t>(offset)));
+        site.format = std::string(read_text(offset));
+        read_text(offset); // file
+        site.defined = true;
+      } else if (tag == binary_log_detail::THREAD) {
+        const auto index = read<uint32_t>(offset);
+        if (_threads.size() <= index)
+          _threads.resize(index + 1);
+        _threads[index] = std::string(read_text(offset));
+      } else if (tag == binary_log_detail::CHUNK) {
+        chunk_threads.push_back(read<uint32_t>(offset));
+        const auto size = read<uint32_t>(offset);
+        if (offset + size > _size)
+          throw std::runtime_error("Truncated binary log");
+        chunks.emplace_back(offset, offset + size);
+        offset += size;
+      } else {
+        throw std::runtime_error("Corrupted binary log");
+      }
+    }
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      for (size_t position = chunks[i].first; position < chunks[i].second;) {
+        Event event;
+        event.site_id = read<uint32_t>(position);
+        event.timestamp = read<int64_t>(position);
+        event.thread_index = chunk_threads[i];
+        event.args_offset = position;
+        if (event.site_id >= _sites.size() || !_sites[event.site_id].defined)
+          throw std::runtime_error("Binary log event refers to an unknown call site");
+        for (BinaryLogArgType type : _sites[event.site_id].arg_types)
+          position += arg_size(type, position);
+        _events.push_back(event);
+      }
+    }
+  }
+
+  void append_arg(std::string &line, BinaryLogArgType type, size_t &offset) {
+    std::ostringstream stream;
+    switch (type) {
+    case BinaryLogArgType::BOOL:
+      stream << static_cast<bool>(read<uint8_t>(offset));
+      break;
+    case BinaryLogArgType::CHAR:
+      line.push_back(read<char>(offset));
+      return;
+    case BinaryLogArgType::INT16:
+      stream << read<int16_t>(offset);
+      break;
+    case BinaryLogArgType::INT32:
+      stream << read<int32_t>(offset);
+      break;
+    case BinaryLogArgType::INT64:
+      stream << read<int64_t>(offset);
+      break;
+    case BinaryLogArgType::UINT16:
+      stream << read<uint16_t>(offset);
+      break;
+    case BinaryLogArgType::UINT32:
+      stream << read<uint32_t>(offset);
+      break;
+    case BinaryLogArgType::UINT64:
+      stream << read<uint64_t>(offset);
+      break;
+    case BinaryLogArgType::FLOAT:
+      stream << read<float>(offset);
+      break;
+    case BinaryLogArgType::DOUBLE:
+      stream << read<double>(offset);
+      break;
+    case BinaryLogArgType::STRING:
+      line.append(read_text(offset));
+      return;
+    }
+    line.append(stream.str());
+  }
+
+  void format_event(const Event &event, std::string &line) {
+    const Site &site = _sites[event.site_id];
+    char timestamp[LogPrefix::timestamp_size];
+    LogPrefix::write_timestamp(timestamp, std::chrono::system_clock::time_point(
+                                              std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                                  std::chrono::nanoseconds(event.timestamp))));
+    const std::string_view thread_id =
+        event.thread_index < _threads.size() ? std::string_view(_threads[event.thread_index]) : "unknown";
+
+    line.clear();
+    LogPrefix::append(line, std::string_view(timestamp, sizeof(timestamp)), thread_id,
+                      Logger::get_severity_string(site.severity));
+    size_t offset = event.args_offset;
+    size_t arg = 0;
+    const std::string &format = site.format;
+    for (size_t i = 0; i < format.size(); ++i) {
+      if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && arg < site.arg_types.size()) {
+        append_arg(line, site.arg_types[arg++], offset);
+        ++i;
+      } else {
+        line.push_back(format[i]);
+      }
+    }
+    line.push_back('\n');
+  }
+
+  const char *_data;
+  size_t _size;
+  std::vector<Site> _sites;
+  std::vector<std::string> _threads;
+  std::vector<Event> _events;
+};
+
+} // namespace common_util
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+
+namespace common_util {
+
+/*
+Integer calendar math on the proleptic Gregorian calendar, no tables, no time zone, no libc.
+Years are counted in 400 year eras of 146097 days, within an era the year starts on March 1st so the leap day is the
+last day of the year. See http://howardhinnant.github.io/date_algorithms.html
+*/
+
+// days since 1970-01-01 of year/month/day. Linear in day, day 31 of a 30 day month is the 1st of the next one
+constexpr int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+  const unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+struct CivilDate {
+  int64_t year;
+  unsigned month; // 1 - 12
+  unsigned day;   // 1 - 31
+};
+
+// inverse of days_from_civil
+constexpr CivilDate civil_from_days(int64_t days) {
+  days += 719468;
+  const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+  const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  const unsigned shifted_month = (5 * day_of_year + 2) / 153; // March is 0
+  const unsigned month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+  return {static_cast<int64_t>(year_of_era) + era * 400 + (month <= 2), month,
+          day_of_year - (153 * shifted_month + 2) / 5 + 1};
+}
+
+// days since January 1st of year (0 - 365)
+constexpr unsigned day_of_year(int64_t year, unsigned month, unsigned day) {
+  return static_cast<unsigned>(days_from_civil(year, month, day) - days_from_civil(year, 1, 1));
+}
+
+// floor division of seconds into days since epoch, negative times included
+constexpr int64_t days_from_time(int64_t seconds) { return (seconds >= 0 ? seconds : seconds - 86399) / 86400; }
+
+static_assert(days_from_civil(1970, 1, 1) == 0);
+static_assert(days_from_civil(2000, 3, 1) == 11017);
+static_assert(civil_from_days(11017).year == 2000 && civil_from_days(11017).month == 3);
+static_assert(civil_from_days(-1).year == 1969 && civil_from_days(-1).day == 31);
+
+} // namespace common_util
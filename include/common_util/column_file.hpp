@@ -0,0 +1,303 @@
+#pragma once
+#include "../endian/endian.hpp"
+#include "memory_map_util.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace common_util {
+
+enum class ColumnType : uint8_t {
+  INT8 = 1,
+  UINT8,
+  INT16,
+  UINT16,
+  INT32,
+  UINT32,
+  INT64,
+  UINT64,
+  FLOAT32,
+  FLOAT64,
+};
+
+template <typename T> constexpr ColumnType column_type() {
+  using U = std::remove_cv_t<T>;
+  static_assert(std::is_arithmetic_v<U> && !std::is_same_v<U, bool>, "columns hold integers or floating point");
+  if constexpr (std::is_floating_point_v<U>) {
+    static_assert(sizeof(U) == 4 || sizeof(U) == 8, "float and double columns only");
+    return sizeof(U) == 4 ? ColumnType::FLOAT32 : ColumnType::FLOAT64;
+  } else if constexpr (sizeof(U) == 1) {
+    return std::is_signed_v<U> ? ColumnType::INT8 : ColumnType::UINT8;
+  } else if constexpr (sizeof(U) == 2) {
+    return std::is_signed_v<U> ? ColumnType::INT16 : ColumnType::UINT16;
+  } else if constexpr (sizeof(U) == 4) {
+    return std::is_signed_v<U> ? ColumnType::INT32 : ColumnType::UINT32;
+  } else {
+    return std::is_signed_v<U> ? ColumnType::INT64 : ColumnType::UINT64;
+  }
+}
+
+// bytes per value, 0 for an unknown type
+constexpr size_t column_type_size(ColumnType type) {
+  switch (type) {
+  case ColumnType::INT8:
+  case ColumnType::UINT8:
+    return 1;
+  case ColumnType::INT16:
+  case ColumnType::UINT16:
+    return 2;
+  case ColumnType::INT32:
+  case ColumnType::UINT32:
+  case ColumnType::FLOAT32:
+    return 4;
+  case ColumnType::INT64:
+  case ColumnType::UINT64:
+  case ColumnType::FLOAT64:
+    return 8;
+  }
+  return 0;
+}
+
+struct ColumnInfo {
+  std::string name;
+  ColumnType type;
+  uint64_t offset = 0; // from file start, multiple of column_file::alignment
+  uint64_t bytes = 0;
+};
+
+/*
+Self describing columnar file, every column is one contiguous array so a scan only pages in the columns it reads.
+
+  header (integers little endian, written through Endian)
+    magic "CUCOLF01" | uint32 version | uint8 byte order of the column data (0 little, 1 big) | 3 bytes zero
+    uint32 column count | uint64 row count | uint64 header bytes
+    per column: uint8 type | uint8 zero | uint16 name length | name | uint64 offset | uint64 bytes
+  zero padding to the next 64 byte boundary, then the column regions, each starting 64 byte aligned
+
+Column values are stored in the writer's byte order, a reader on a host of the other order gets an error.
+*/
+namespace column_file {
+
+constexpr char magic[8] = {'C', 'U', 'C', 'O', 'L', 'F', '0', '1'};
+constexpr uint32_t version = 1;
+constexpr size_t alignment = 64;
+constexpr size_t fixed_header_size = sizeof(magic) + 4 + 4 + 4 + 8 + 8;
+
+constexpr uint64_t align(uint64_t offset) { return (offset + alignment - 1) / alignment * alignment; }
+
+inline uint8_t host_byte_order() { return Endian::isLittleEndian() ? 0 : 1; }
+
+} // namespace column_file
+
+// zero-copy typed view of one column, valid as long as the ColumnFile / ColumnFileWriter lives
+template <typename T> class ColumnView final {
+public:
+  ColumnView() = default;
+  ColumnView(T *data, size_t size) : _data(data), _size(size) {}
+
+  T *begin() const { return _data; }
+  T *end() const { return _data + _size; }
+  T *data() const { return _data; }
+  size_t size() const { return _size; }
+  T &operator[](size_t row) const { return _data[row]; }
+
+private:
+  T *_data = nullptr;
+  size_t _size = 0;
+};
+
+/*
+Creates a column file for row_count rows. The whole file is mapped at once, fill the columns through column<T>().
+  common_util::ColumnFileWriter writer("ticks.col", rows,
+                                       {{"timestamp", ColumnType::INT64}, {"price", ColumnType::FLOAT64}});
+  auto timestamps = writer.column<int64_t>("timestamp");
+*/
+class ColumnFileWriter final {
+public:
+  struct Column {
+    std::string name;
+    ColumnType type;
+  };
+
+  ColumnFileWriter(const std::filesystem::path &path, uint64_t row_count, std::initializer_list<Column> columns)
+      : ColumnFileWriter(path, row_count, std::vector<Column>(columns)) {}
+
+  ColumnFileWriter(const std::filesystem::path &path, uint64_t row_count, const std::vector<Column> &columns)
+      : _row_count(row_count) {
+    uint64_t header_size = column_file::fixed_header_size;
+    for (const auto &column : columns) {
+      if (!column_type_size(column.type))
+        throw std::invalid_argument("Unknown type of column :- " + column.name);
+      if (column.name.size() > UINT16_MAX)
+        throw std::invalid_argument("Column name too long :- " + column.name);
+      header_size += 1 + 1 + 2 + column.name.size() + 8 + 8;
+    }
+    uint64_t offset = column_file::align(header_size);
+    for (const auto &column : columns) {
+      const uint64_t bytes = row_count * column_type_size(column.type);
+      _columns.push_back({column.name, column.type, offset, bytes});
+      offset = column_file::align(offset + bytes);
+    }
+
+    _file = std::make_unique<WMemoryMapped<char>>(path, offset);
+    write_header(header_size);
+  }
+
+  uint64_t row_count() const { return _row_count; }
+  const std::vector<ColumnInfo> &columns() const { return _columns; }
+
+  // throws std::out_of_range for an unknown name, std::invalid_argument if T doesn't match the column type
+  template <typename T> ColumnView<T> column(std::string_view name) {
+    const ColumnInfo &info = find(name);
+    if (info.type != column_type<T>())
+      throw std::invalid_argument("Type doesn't match column :- " + info.name);
+    return ColumnView<T>(reinterpret_cast<T *>(_file->begin() + info.offset), _row_count);
+  }
+
+  void flush() { _file->flush(); }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  ColumnFileWriter(const ColumnFileWriter &) = delete;
+  ColumnFileWriter &operator=(const ColumnFileWriter &) = delete;
+  ColumnFileWriter(ColumnFileWriter &&) = delete;
+  ColumnFileWriter &operator=(ColumnFileWriter &&) = delete;
+
+private:
+  const ColumnInfo &find(std::string_view name) const {
+    for (const auto &column : _columns)
+      if (column.name == name)
+        return column;
+    throw std::out_of_range("No such column :- " + std::string(name));
+  }
+
+  void write_header(uint64_t header_size) {
+    char *out = _file->begin();
+    std::memcpy(out, column_file::magic, sizeof(column_file::magic));
+    out += sizeof(column_file::magic);
+    out += Endian::writeLittleEndian(out, column_file::version);
+    out[0] = static_cast<char>(column_file::host_byte_order());
+    out[1] = out[2] = out[3] = 0;
+    out += 4;
+    out += Endian::writeLittleEndian(out, static_cast<uint32_t>(_columns.size()));
+    out += Endian::writeLittleEndian(out, _row_count);
+    out += Endian::writeLittleEndian(out, header_size);
+    for (const auto &column : _columns) {
+      *out++ = static_cast<char>(column.type);
+      *out++ = 0;
+      out += Endian::writeLittleEndian(out, static_cast<uint16_t>(column.name.size()));
+      std::memcpy(out, column.name.data(), column.name.size());
+      out += column.name.size();
+      out += Endian::writeLittleEndian(out, column.offset);
+      out += Endian::writeLittleEndian(out, column.bytes);
+    }
+  }
+
+  uint64_t _row_count;
+  std::vector<ColumnInfo> _columns;
+  std::unique_ptr<WMemoryMapped<char>> _file;
+};
+
+/*
+Reads a column file through RMemoryMapped, columns are handed out as views straight into the mapping. Only the pages
+of columns that get read are faulted in. Throws std::runtime_error if the file isn't a valid column file.
+  common_util::ColumnFile ticks("ticks.col");
+  for (const double price : ticks.column<double>("price")) ...
+*/
+class ColumnFile final {
+public:
+  explicit ColumnFile(const std::filesystem::path &path, const MapPolicy &policy = {}) : _file(path, policy) {
+    parse_header();
+  }
+
+  uint64_t row_count() const { return _row_count; }
+  const std::vector<ColumnInfo> &columns() const { return _columns; }
+
+  bool has_column(std::string_view name) const {
+    for (const auto &column : _columns)
+      if (column.name == name)
+        return true;
+    return false;
+  }
+
+  // throws std::out_of_range for an unknown name, std::invalid_argument if T doesn't match the column type
+  template <typename T> ColumnView<const T> column(std::string_view name) {
+    const ColumnInfo &info = find(name);
+    if (info.type != column_type<T>())
+      throw std::invalid_argument("Type doesn't match column :- " + info.name);
+    return ColumnView<const T>(reinterpret_cast<const T *>(_file.begin() + info.offset), _row_count);
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  ColumnFile(const ColumnFile &) = delete;
+  ColumnFile &operator=(const ColumnFile &) = delete;
+  ColumnFile(ColumnFile &&) = delete;
+  ColumnFile &operator=(ColumnFile &&) = delete;
+
+private:
+  const ColumnInfo &find(std::string_view name) const {
+    for (const auto &column : _columns)
+      if (column.name == name)
+        return column;
+    throw std::out_of_range("No such column :- " + std::string(name));
+  }
+
+  void parse_header() {
+    const char *data = _file.begin();
+    const size_t size = _file.size();
+    size_t position = 0;
+    const auto need = [&](size_t bytes) {
+      if (size - position < bytes)
+        throw std::runtime_error("Column file header truncated");
+    };
+
+    need(column_file::fixed_header_size);
+    if (std::memcmp(data, column_file::magic, sizeof(column_file::magic)) != 0)
+      throw std::runtime_error("Not a column file");
+    position += sizeof(column_file::magic);
+    uint32_t file_version, column_count;
+    uint64_t header_size;
+    position += Endian::readLittleEndian(data + position, file_version);
+    if (file_version != column_file::version)
+      throw std::runtime_error("Unsupported column file version " + std::to_string(file_version));
+    if (static_cast<uint8_t>(data[position]) != column_file::host_byte_order())
+      throw std::runtime_error("Column file was written with the other byte order");
+    position += 4;
+    position += Endian::readLittleEndian(data + position, column_count);
+    position += Endian::readLittleEndian(data + position, _row_count);
+    position += Endian::readLittleEndian(data + position, header_size);
+
+    for (uint32_t i = 0; i < column_count; ++i) {
+      ColumnInfo column;
+      uint16_t name_size;
+      need(4);
+      column.type = static_cast<ColumnType>(data[position]);
+      position += 2;
+      position += Endian::readLittleEndian(data + position, name_size);
+      need(name_size + 16u);
+      column.name.assign(data + position, name_size);
+      position += name_size;
+      position += Endian::readLittleEndian(data + position, column.offset);
+      position += Endian::readLittleEndian(data + position, column.bytes);
+
+      const size_t value_size = column_type_size(column.type);
+      if (!value_size || column.bytes != _row_count * value_size || column.offset % column_file::alignment ||
+          column.offset < header_size || column.offset > size || size - column.offset < column.bytes)
+        throw std::runtime_error("Invalid column in column file :- " + column.name);
+      _columns.push_back(std::move(column));
+    }
+  }
+
+  RMemoryMapped<char> _file;
+  uint64_t _row_count = 0;
+  std::vector<ColumnInfo> _columns;
+};
+
+} // namespace common_util
@@ -0,0 +1,439 @@
+#pragma once
+#include "../endian/endian.hpp"
+#include "memory_map_util.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMMON_UTIL_CODEC_X86 1
+#endif
+
+namespace common_util {
+
+/*
+Delta + zigzag + bit packing for int64 columns (timestamps, prices in ticks), in independent blocks of 256 values.
+Within a block every value is stored as the zigzag encoded difference to its predecessor, packed with the bit width of
+the largest one. Sorted timestamps and slowly moving prices need a few bits per value instead of 64.
+
+  block (host byte order)
+    int64 first value | uint16 value count | uint8 bit width | 5 bytes zero | uint64 words[4 * bit width]
+  value i of the block sits in lane i % 4 at bit (i / 4) * width of that lane, word k of lane l is words[k * 4 + l]
+
+The four interleaved lanes let one 256 bit register unpack four consecutive values with the same shifts, so decoding
+is shift, mask, zigzag and a prefix sum on whole registers. decode_block() picks the AVX2, SSE4.1 or scalar kernel at
+runtime, all of them read the same format.
+*/
+namespace integer_codec {
+
+constexpr size_t block_values = 256;
+constexpr size_t block_header_size = 16;
+// largest encoded block, 64 bit width
+constexpr size_t max_block_bytes = block_header_size + 4 * 64 * sizeof(uint64_t);
+
+constexpr uint64_t zigzag_encode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+constexpr int64_t zigzag_decode(uint64_t value) {
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+constexpr size_t block_bytes_for(unsigned width) { return block_header_size + 4 * sizeof(uint64_t) * width; }
+
+// bytes of the encoded block starting at in
+inline size_t block_bytes(const char *in) { return block_bytes_for(static_cast<uint8_t>(in[10])); }
+
+/*
+Encodes values[0, count), count 1 .. block_values, to out which needs max_block_bytes room.
+Returns the bytes written. Differences wrap around, every int64 sequence round trips.
+*/
+inline size_t encode_block(const int64_t *values, size_t count, char *out) {
+  count = std::min(count, block_values);
+  uint64_t zigzag[block_values] = {};
+  uint64_t any = 0;
+  for (size_t i = 1; i < count; ++i) {
+    zigzag[i] = zigzag_encode(static_cast<int64_t>(static_cast<uint64_t>(values[i]) - values[i - 1]));
+    any |= zigzag[i];
+  }
+  const unsigned width = any ? 64 - __builtin_clzll(any) : 0;
+  const uint16_t value_count = static_cast<uint16_t>(count);
+  std::memset(out, 0, block_bytes_for(width));
+  std::memcpy(out, values, sizeof(int64_t));
+  std::memcpy(out + 8, &value_count, sizeof(value_count));
+  out[10] = static_cast<char>(width);
+
+  uint64_t *words = reinterpret_cast<uint64_t *>(out + block_header_size);
+  for (size_t i = 0; width && i < block_values; ++i) {
+    const size_t lane = i % 4;
+    const size_t bit = (i / 4) * width;
+    const size_t word = bit / 64;
+    const unsigned shift = bit % 64;
+    words[word * 4 + lane] |= zigzag[i] << shift;
+    if (shift + width > 64)
+      words[(word + 1) * 4 + lane] |= zigzag[i] >> (64 - shift);
+  }
+  return block_bytes_for(width);
+}
+
+/*
+Decoders, out needs room for block_values values (the padding after value count is written too).
+Return the value count of the block.
+*/
+inline size_t decode_block_scalar(const char *in, int64_t *out) {
+  int64_t first;
+  uint16_t count;
+  std::memcpy(&first, in, sizeof(first));
+  std::memcpy(&count, in + 8, sizeof(count));
+  const unsigned width = static_cast<uint8_t>(in[10]);
+  if (!width) {
+    std::fill(out, out + block_values, first);
+    return count;
+  }
+  const uint64_t *words = reinterpret_cast<const uint64_t *>(in + block_header_size);
+  const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+  uint64_t value = static_cast<uint64_t>(first);
+  for (size_t row = 0; row < block_values / 4; ++row) {
+    const size_t bit = row * width;
+    const size_t word = bit / 64;
+    const unsigned shift = bit % 64;
+    for (size_t lane = 0; lane < 4; ++lane) {
+      uint64_t zigzag = words[word * 4 + lane] >> shift;
+      if (shift + width > 64)
+        zigzag |= words[(word + 1) * 4 + lane] << (64 - shift);
+      value += static_cast<uint64_t>(zigzag_decode(zigzag & mask));
+      out[row * 4 + lane] = static_cast<int64_t>(value);
+    }
+  }
+  return count;
+}
+
+#ifdef COMMON_UTIL_CODEC_X86
+// lanes 0,1 and 2,3 of a row in two registers
+__attribute__((target("sse4.1"))) inline size_t decode_block_sse41(const char *in, int64_t *out) {
+  const unsigned width = static_cast<uint8_t>(in[10]);
+  if (!width)
+    return decode_block_scalar(in, out);
+  int64_t first;
+  uint16_t count;
+  std::memcpy(&first, in, sizeof(first));
+  std::memcpy(&count, in + 8, sizeof(count));
+  const __m128i *words = reinterpret_cast<const __m128i *>(in + block_header_size);
+  const __m128i mask = _mm_set1_epi64x(width == 64 ? -1 : static_cast<int64_t>((uint64_t(1) << width) - 1));
+  const __m128i one = _mm_set1_epi64x(1);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i carry = _mm_set1_epi64x(first);
+  for (size_t row = 0; row < block_values / 4; ++row) {
+    const size_t bit = row * width;
+    const size_t word = bit / 64;
+    const unsigned shift = bit % 64;
+    __m128i low = _mm_srl_epi64(_mm_loadu_si128(words + word * 2), _mm_cvtsi32_si128(static_cast<int>(shift)));
+    __m128i high = _mm_srl_epi64(_mm_loadu_si128(words + word * 2 + 1), _mm_cvtsi32_si128(static_cast<int>(shift)));
+    if (shift + width > 64) {
+      const __m128i spill = _mm_cvtsi32_si128(static_cast<int>(64 - shift));
+      low = _mm_or_si128(low, _mm_sll_epi64(_mm_loadu_si128(words + (word + 1) * 2), spill));
+      high = _mm_or_si128(high, _mm_sll_epi64(_mm_loadu_si128(words + (word + 1) * 2 + 1), spill));
+    }
+    low = _mm_and_si128(low, mask);
+    high = _mm_and_si128(high, mask);
+    low = _mm_xor_si128(_mm_srli_epi64(low, 1), _mm_sub_epi64(zero, _mm_and_si128(low, one)));
+    high = _mm_xor_si128(_mm_srli_epi64(high, 1), _mm_sub_epi64(zero, _mm_and_si128(high, one)));
+    // prefix sum, [a, b] -> [a, a + b] plus everything before
+    low = _mm_add_epi64(_mm_add_epi64(low, _mm_slli_si128(low, 8)), carry);
+    carry = _mm_unpackhi_epi64(low, low);
+    high = _mm_add_epi64(_mm_add_epi64(high, _mm_slli_si128(high, 8)), carry);
+    carry = _mm_unpackhi_epi64(high, high);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + row * 4), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + row * 4 + 2), high);
+  }
+  return count;
+}
+
+// one row of four lanes per register
+__attribute__((target("avx2"))) inline size_t decode_block_avx2(const char *in, int64_t *out) {
+  const unsigned width = static_cast<uint8_t>(in[10]);
+  if (!width)
+    return decode_block_scalar(in, out);
+  int64_t first;
+  uint16_t count;
+  std::memcpy(&first, in, sizeof(first));
+  std::memcpy(&count, in + 8, sizeof(count));
+  const __m256i *words = reinterpret_cast<const __m256i *>(in + block_header_size);
+  const __m256i mask = _mm256_set1_epi64x(width == 64 ? -1 : static_cast<int64_t>((uint64_t(1) << width) - 1));
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i carry = _mm256_set1_epi64x(first);
+  for (size_t row = 0; row < block_values / 4; ++row) {
+    const size_t bit = row * width;
+    const size_t word = bit / 64;
+    const unsigned shift = bit % 64;
+    __m256i zigzag = _mm256_srl_epi64(_mm256_loadu_si256(words + word), _mm_cvtsi32_si128(static_cast<int>(shift)));
+    if (shift + width > 64)
+      zigzag = _mm256_or_si256(zigzag, _mm256_sll_epi64(_mm256_loadu_si256(words + word + 1),
+                                                        _mm_cvtsi32_si128(static_cast<int>(64 - shift))));
+    zigzag = _mm256_and_si256(zigzag, mask);
+    __m256i delta =
+        _mm256_xor_si256(_mm256_srli_epi64(zigzag, 1), _mm256_sub_epi64(zero, _mm256_and_si256(zigzag, one)));
+    // prefix sum in two steps, shifting by one then two lanes (permute, the byte shift stays inside 128 bit halves)
+    delta = _mm256_add_epi64(delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x90), zero, 0x03));
+    delta = _mm256_add_epi64(delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x40), zero, 0x0F));
+    delta = _mm256_add_epi64(delta, carry);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + row * 4), delta);
+    carry = _mm256_permute4x64_epi64(delta, 0xFF);
+  }
+  return count;
+}
+#endif
+
+using DecodeBlock = size_t (*)(const char *, int64_t *);
+
+// best kernel of this CPU
+inline DecodeBlock select_decode_block() {
+#ifdef COMMON_UTIL_CODEC_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return decode_block_avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return decode_block_sse41;
+#endif
+  return decode_block_scalar;
+}
+
+// "avx2", "sse4.1" or "scalar", the kernel decode_block() uses
+inline const char *decode_kernel_name() {
+#ifdef COMMON_UTIL_CODEC_X86
+  const DecodeBlock decode = select_decode_block();
+  if (decode == decode_block_avx2)
+    return "avx2";
+  if (decode == decode_block_sse41)
+    return "sse4.1";
+#endif
+  return "scalar";
+}
+
+inline size_t decode_block(const char *in, int64_t *out) {
+  static const DecodeBlock decode = select_decode_block();
+  return decode(in, out);
+}
+
+} // namespace integer_codec
+
+/*
+File of one encoded int64 column, written block by block through AMemoryMapped.
+
+  header (integers little endian, written through Endian)
+    magic "CUDZBP01" | uint32 version | uint8 byte order of blocks and block offsets (0 little, 1 big) | 3 bytes zero
+    uint64 value count | uint64 block count | uint64 offset of the block offsets
+  zero padding to 64 bytes | blocks | uint64 block offsets[block count]
+
+  common_util::EncodedColumnWriter writer("ticks.timestamp.dzbp");
+  for (const Tick &tick : ticks)
+    writer.append(tick.timestamp);
+  writer.close();
+*/
+namespace encoded_column {
+
+constexpr char magic[8] = {'C', 'U', 'D', 'Z', 'B', 'P', '0', '1'};
+constexpr uint32_t version = 1;
+constexpr size_t header_size = 64;
+
+inline uint8_t host_byte_order() { return Endian::isLittleEndian() ? 0 : 1; }
+
+} // namespace encoded_column
+
+class EncodedColumnWriter final {
+public:
+  explicit EncodedColumnWriter(const std::filesystem::path &path) : _file(path) {
+    const char header[encoded_column::header_size] = {};
+    _file.append(header, sizeof(header));
+  }
+
+  // a file that wasn't closed is closed here, errors are lost then
+  ~EncodedColumnWriter() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  void append(int64_t value) {
+    _pending[_pending_count++] = value;
+    _value_count++;
+    if (_pending_count == integer_codec::block_values)
+      write_block();
+  }
+
+  void append(const int64_t *values, size_t count) {
+    while (count) {
+      const size_t take = std::min(count, integer_codec::block_values - _pending_count);
+      std::memcpy(_pending + _pending_count, values, take * sizeof(int64_t));
+      _pending_count += take;
+      _value_count += take;
+      values += take;
+      count -= take;
+      if (_pending_count == integer_codec::block_values)
+        write_block();
+    }
+  }
+
+  uint64_t size() const { return _value_count; }
+
+  // bytes written so far, header and blocks
+  size_t encoded_bytes() const { return _file.size(); }
+
+  // encodes the last partial block, appends the block offsets and writes the header
+  void close() {
+    if (_closed)
+      return;
+    _closed = true;
+    if (_pending_count)
+      write_block();
+    const uint64_t offsets_offset = _file.size();
+    if (!_offsets.empty())
+      _file.append(reinterpret_cast<const char *>(_offsets.data()), _offsets.size() * sizeof(uint64_t));
+
+    char *out = _file.begin();
+    std::memcpy(out, encoded_column::magic, sizeof(encoded_column::magic));
+    out += sizeof(encoded_column::magic);
+    out += Endian::writeLittleEndian(out, encoded_column::version);
+    out[0] = static_cast<char>(encoded_column::host_byte_order());
+    out += 4;
+    out += Endian::writeLittleEndian(out, _value_count);
+    out += Endian::writeLittleEndian(out, static_cast<uint64_t>(_offsets.size()));
+    out += Endian::writeLittleEndian(out, offsets_offset);
+    _file.close();
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  EncodedColumnWriter(const EncodedColumnWriter &) = delete;
+  EncodedColumnWriter &operator=(const EncodedColumnWriter &) = delete;
+  EncodedColumnWriter(EncodedColumnWriter &&) = delete;
+  EncodedColumnWriter &operator=(EncodedColumnWriter &&) = delete;
+
+private:
+  void write_block() {
+    char block[integer_codec::max_block_bytes];
+    const size_t bytes = integer_codec::encode_block(_pending, _pending_count, block);
+    _offsets.push_back(_file.size());
+    _file.append(block, bytes);
+    _pending_count = 0;
+  }
+
+  AMemoryMapped<char> _file;
+  int64_t _pending[integer_codec::block_values];
+  size_t _pending_count = 0;
+  uint64_t _value_count = 0;
+  std::vector<uint64_t> _offsets;
+  bool _closed = false;
+};
+
+/*
+Reads an encoded column through RMemoryMapped. Blocks are decoded on demand, a scan only faults in the encoded pages.
+Throws std::runtime_error if the file isn't a valid encoded column.
+  common_util::EncodedColumn timestamps("ticks.timestamp.dzbp");
+  timestamps.for_each_block([&](const int64_t *values, size_t count, uint64_t first_row) { ... });
+*/
+class EncodedColumn final {
+public:
+  explicit EncodedColumn(const std::filesystem::path &path, const MapPolicy &policy = {}) : _file(path, policy) {
+    parse_header(path);
+  }
+
+  uint64_t size() const { return _value_count; }
+  size_t block_count() const { return _block_count; }
+  // file size, compare with size() * sizeof(int64_t)
+  size_t encoded_bytes() const { return _size; }
+
+  // decodes block into out (room for integer_codec::block_values values), returns its value count
+  size_t decode_block(size_t block, int64_t *out) const {
+    const char *in = _data + _offsets[block];
+    if (static_cast<uint8_t>(in[10]) > 64 || _size - _offsets[block] < integer_codec::block_bytes(in))
+      throw std::runtime_error("Corrupt block in encoded column :- " + std::to_string(block));
+    return integer_codec::decode_block(in, out);
+  }
+
+  // values [from, from + count) to out, throws std::out_of_range past size()
+  void decode(uint64_t from, size_t count, int64_t *out) const {
+    if (from > _value_count || _value_count - from < count)
+      throw std::out_of_range("Encoded column has " + std::to_string(_value_count) + " values");
+    int64_t buffer[integer_codec::block_values];
+    while (count) {
+      const size_t block = from / integer_codec::block_values;
+      const size_t skip = from % integer_codec::block_values;
+      const size_t take = std::min(count, integer_codec::block_values - skip);
+      // whole blocks go straight to out
+      if (!skip && take == integer_codec::block_values) {
+        decode_block(block, out);
+      } else {
+        decode_block(block, buffer);
+        std::memcpy(out, buffer + skip, take * sizeof(int64_t));
+      }
+      from += take;
+      out += take;
+      count -= take;
+    }
+  }
+
+  int64_t at(uint64_t row) const {
+    int64_t value;
+    decode(row, 1, &value);
+    return value;
+  }
+
+  // f(const int64_t *values, size_t count, uint64_t first_row) for every block in order
+  template <typename F> void for_each_block(F &&f) const {
+    alignas(32) int64_t buffer[integer_codec::block_values];
+    for (size_t block = 0; block < _block_count; ++block) {
+      const size_t count = decode_block(block, buffer);
+      f(static_cast<const int64_t *>(buffer), count, static_cast<uint64_t>(block) * integer_codec::block_values);
+    }
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  EncodedColumn(const EncodedColumn &) = delete;
+  EncodedColumn &operator=(const EncodedColumn &) = delete;
+  EncodedColumn(EncodedColumn &&) = delete;
+  EncodedColumn &operator=(EncodedColumn &&) = delete;
+
+private:
+  void parse_header(const std::filesystem::path &path) {
+    const char *data = _data = _file.begin();
+    const size_t size = _size = _file.size();
+    if (size < encoded_column::header_size || std::memcmp(data, encoded_column::magic, sizeof(encoded_column::magic)))
+      throw std::runtime_error("Not an encoded column :- " + path.string());
+    size_t position = sizeof(encoded_column::magic);
+    uint32_t file_version;
+    uint64_t block_count, offsets_offset;
+    position += Endian::readLittleEndian(data + position, file_version);
+    if (file_version != encoded_column::version)
+      throw std::runtime_error("Unsupported encoded column version " + std::to_string(file_version));
+    if (static_cast<uint8_t>(data[position]) != encoded_column::host_byte_order())
+      throw std::runtime_error("Encoded column was written with the other byte order");
+    position += 4;
+    position += Endian::readLittleEndian(data + position, _value_count);
+    position += Endian::readLittleEndian(data + position, block_count);
+    position += Endian::readLittleEndian(data + position, offsets_offset);
+    if (block_count != (_value_count + integer_codec::block_values - 1) / integer_codec::block_values ||
+        offsets_offset > size || (size - offsets_offset) / sizeof(uint64_t) < block_count)
+      throw std::runtime_error("Encoded column truncated :- " + path.string());
+    _block_count = block_count;
+    _offsets = reinterpret_cast<const uint64_t *>(data + offsets_offset);
+    for (size_t block = 0; block < _block_count; ++block)
+      if (_offsets[block] < encoded_column::header_size ||
+          offsets_offset - std::min(offsets_offset, _offsets[block]) < integer_codec::block_header_size)
+        throw std::runtime_error("Invalid block offset in encoded column :- " + path.string());
+  }
+
+  RMemoryMapped<char> _file;
+  const char *_data = nullptr;
+  size_t _size = 0;
+  uint64_t _value_count = 0;
+  size_t _block_count = 0;
+  const uint64_t *_offsets = nullptr;
+};
+
+} // namespace common_util
@@ -0,0 +1,360 @@
+#pragma once
+#include "memory_map_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace common_util {
+
+/*
+writes all of iov to fd. Retries on EINTR and continues after short writes, iov gets modified on the way.
+returns false if the descriptor reported an error.
+*/
+inline bool write_fully(int fd, struct iovec *iov, int iov_count) {
+  while (iov_count > 0) {
+    const ssize_t written = ::writev(fd, iov, iov_count < IOV_MAX ? iov_count : IOV_MAX);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    size_t remaining = static_cast<size_t>(written);
+    while (iov_count > 0 && remaining >= iov->iov_len) {
+      remaining -= iov->iov_len;
+      ++iov;
+      --iov_count;
+    }
+    if (iov_count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + remaining;
+      iov->iov_len -= remaining;
+    }
+  }
+  return true;
+}
+
+inline bool write_fully(int fd, const char *data, size_t size) {
+  struct iovec iov {
+    const_cast<char *>(data), size
+  };
+  return write_fully(fd, &iov, 1);
+}
+
+/*
+When a log file gets closed and renamed to "<filename>.<index>", index counts up from 1. open() continues after the
+highest index already on disk, so a restarted process doesn't rename over the rotated files of the previous run, and
+rotates a non empty file it finds first. A file is never rotated while it's empty.
+*/
+struct LogRotation {
+  size_t max_bytes = 0;             // rotate before the file would grow past this, 0: no size limit
+  std::chrono::seconds interval{0}; // rotate on multiples of interval since epoch (UTC), 0: never
+  size_t retention = 0;             // rotated files to keep, older ones get deleted, 0: keep all
+
+  bool has_interval() const { return interval.count() > 0; }
+
+  std::chrono::system_clock::time_point next_rotation(std::chrono::system_clock::time_point now) const {
+    const auto since_epoch = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch());
+    return std::chrono::system_clock::time_point((since_epoch / interval + 1) * interval);
+  }
+
+  static std::string rotated_path(const std::string &filename, size_t index) {
+    return filename + "." + std::to_string(index);
+  }
+
+  // renames filename to its rotated name and deletes what falls out of retention
+  void retire(const std::string &filename, size_t index) const {
+    ::rename(filename.c_str(), rotated_path(filename, index).c_str());
+    if (retention && index > retention)
+      ::unlink(rotated_path(filename, index - retention).c_str());
+  }
+
+  /*
+  Index the next rotation of filename follows, for open(): the highest "<filename>.<index>" on disk, after filename
+  itself was rotated if it isn't empty. Rotated files out of retention, left by a run with a larger retention, are
+  deleted.
+  */
+  size_t resume(const std::string &filename) const {
+    const std::filesystem::path path(filename);
+    const std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : ".";
+    const std::string prefix = path.filename().string() + ".";
+    std::vector<size_t> indexes;
+    std::error_code error;
+    for (std::filesystem::directory_iterator entry(directory, error), end; !error && entry != end;
+         entry.increment(error)) {
+      const std::string name = entry->path().filename().string();
+      // 19 digits always fit size_t
+      if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+          name.size() - prefix.size() > 19 ||
+          !std::all_of(name.begin() + prefix.size(), name.end(), [](char c) { return c >= '0' && c <= '9'; }))
+        continue;
+      indexes.push_back(std::stoull(name.substr(prefix.size())));
+    }
+    size_t last = indexes.empty() ? 0 : *std::max_element(indexes.begin(), indexes.end());
+    struct stat status;
+    if (::stat(filename.c_str(), &status) == 0 && status.st_size > 0)
+      retire(filename, ++last);
+    if (retention)
+      for (const size_t index : indexes)
+        if (index + retention <= last)
+          ::unlink(rotated_path(filename, index).c_str());
+    return last;
+  }
+};
+
+/*
+Unbuffered append only log file on a plain descriptor. Every write goes straight to the kernel, so there is no
+user space buffer to flush and a batch of lines can be handed over with a single writev.
+Rotation (see LogRotation) happens between writes, a line or batch never gets split over two files.
+Not thread safe, callers serialize writes.
+*/
+class LogFile final {
+public:
+  LogFile() = default;
+  ~LogFile() { close(); }
+
+  // without rotation an existing file is truncated, same as std::ofstream with std::ios::out
+  void open(const std::string &filename, const LogRotation &rotation = {}) {
+    close();
+    _filename = filename;
+    _rotation = rotation;
+    _rotated = rotation.max_bytes || rotation.has_interval() ? rotation.resume(filename) : 0;
+    if (!open_current()) {
+      throw std::system_error(errno, std::iostream_category(), "Can't open log file :- " + filename);
+    }
+  }
+
+  bool is_open() const { return _file != -1; }
+
+  bool write(const char *data, size_t size) {
+    rotate_if_needed(size);
+    _bytes_written += size;
+    return write_fully(_file, data, size);
+  }
+  bool write(const std::string &data) { return write(data.data(), data.size()); }
+  bool writev(struct iovec *iov, int iov_count) {
+    size_t size = 0;
+    for (int i = 0; i < iov_count; ++i)
+      size += iov[i].iov_len;
+    rotate_if_needed(size);
+    _bytes_written += size;
+    return write_fully(_file, iov, iov_count);
+  }
+
+  void close() {
+    if (_file != -1) {
+      ::close(_file);
+      _file = -1;
+    }
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  LogFile(const LogFile &) = delete;
+  LogFile &operator=(const LogFile &) = delete;
+  LogFile(LogFile &&) = delete;
+  LogFile &operator=(LogFile &&) = delete;
+
+private:
+  bool open_current() {
+    _file = ::open(_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, (mode_t)0666);
+    _bytes_written = 0;
+    if (_rotation.has_interval())
+      _next_rotation = _rotation.next_rotation(std::chrono::system_clock::now());
+    return _file != -1;
+  }
+
+  void rotate_if_needed(size_t incoming) {
+    if (!_bytes_written)
+      return;
+    const bool size_reached = _rotation.max_bytes && _bytes_written + incoming > _rotation.max_bytes;
+    const bool time_reached = _rotation.has_interval() && std::chrono::system_clock::now() >= _next_rotation;
+    if (!size_reached && !time_reached)
+      return;
+    close();
+    _rotation.retire(_filename, ++_rotated);
+    // on failure writes fail until the next open(), same as a descriptor that went bad
+    open_current();
+  }
+
+  int _file = -1;
+  std::string _filename;
+  LogRotation _rotation;
+  size_t _rotated = 0;
+  size_t _bytes_written = 0;
+  std::chrono::system_clock::time_point _next_rotation;
+};
+
+/*
+Log file written through preallocated WMemoryMapped<char> segments. A writer reserves its bytes with one atomic add
+on the segment cursor and copies the line into the mapping, there is no lock and no syscall per line. Lines become
+visible in the page cache right away and survive a crash of the process.
+When a segment is full (or the rotation interval passed) the current file is renamed the same way LogFile rotates,
+a new segment is mapped under filename and the old one is truncated to what was written.
+Safe to call write() from any number of threads.
+*/
+class MappedLogFile final {
+  struct Segment {
+    std::unique_ptr<WMemoryMapped<char>> mapping;
+    size_t capacity = 0;
+    size_t index = 0;                  // rotated file index this segment will get
+    std::atomic<size_t> cursor{0};     // reserved bytes, can run past capacity
+    std::atomic<size_t> committed{0};  // bytes of successful reservations, they always form a prefix
+    std::atomic<uint32_t> writers{0};  // threads between reservation and end of copy
+  };
+
+public:
+  static constexpr size_t default_segment_size = 64 * 1024 * 1024;
+
+  MappedLogFile() = default;
+  ~MappedLogFile() { close(); }
+
+  // continues the rotated files on disk (see LogRotation). rotation.max_bytes is ignored, segment_size is the
+  // size limit
+  void open(const std::string &filename, size_t segment_size = default_segment_size,
+            const LogRotation &rotation = {}) {
+    close();
+    _filename = filename;
+    _segment_size = segment_size;
+    _rotation = rotation;
+    _rotated = rotation.resume(filename);
+    _broken.store(false, std::memory_order_relaxed);
+    _segments.push_back(map_segment(_segment_size));
+    _current.store(_segments.back().get(), std::memory_order_seq_cst);
+  }
+
+  bool is_open() const { return _current.load(std::memory_order_acquire) != nullptr; }
+
+  bool write(const char *data, size_t size) {
+    for (;;) {
+      Segment *segment = _current.load(std::memory_order_seq_cst);
+      if (!segment)
+        return false;
+      if (_rotation.has_interval() && std::chrono::system_clock::now() >= next_rotation_time()) {
+        rotate(segment, size);
+        continue;
+      }
+      segment->writers.fetch_add(1, std::memory_order_seq_cst);
+      // recheck, rotate() may have swapped the segment before the writer count went up
+      if (_current.load(std::memory_order_seq_cst) != segment) {
+        segment->writers.fetch_sub(1, std::memory_order_release);
+        continue;
+      }
+      const size_t offset = segment->cursor.fetch_add(size, std::memory_order_relaxed);
+      if (offset + size <= segment->capacity) {
+        std::memcpy(segment->mapping->begin() + offset, data, size);
+        segment->committed.fetch_add(size, std::memory_order_relaxed);
+        segment->writers.fetch_sub(1, std::memory_order_release);
+        return true;
+      }
+      segment->writers.fetch_sub(1, std::memory_order_release);
+      if (_broken.load(std::memory_order_acquire))
+        return false;
+      rotate(segment, size);
+    }
+  }
+  bool write(const std::string &data) { return write(data.data(), data.size()); }
+
+  // no writer may run concurrently with close()
+  void close() {
+    Segment *segment = _current.exchange(nullptr, std::memory_order_seq_cst);
+    if (segment)
+      finish(*segment);
+    _segments.clear();
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MappedLogFile(const MappedLogFile &) = delete;
+  MappedLogFile &operator=(const MappedLogFile &) = delete;
+  MappedLogFile(MappedLogFile &&) = delete;
+  MappedLogFile &operator=(MappedLogFile &&) = delete;
+
+private:
+  std::unique_ptr<Segment> map_segment(size_t capacity) {
+    auto segment = std::make_unique<Segment>();
+    segment->mapping = std::make_unique<WMemoryMapped<char>>(_filename, capacity);
+    segment->capacity = capacity;
+    set_next_rotation();
+    return segment;
+  }
+
+  void set_next_rotation() {
+    if (_rotation.has_interval())
+      _next_rotation.store(_rotation.next_rotation(std::chrono::system_clock::now()).time_since_epoch().count(),
+                           std::memory_order_relaxed);
+  }
+
+  std::chrono::system_clock::time_point next_rotation_time() const {
+    return std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(_next_rotation.load(std::memory_order_relaxed)));
+  }
+
+  // waits for the last writers, unmaps and cuts the file down to the written bytes
+  void finish(Segment &segment) {
+    while (segment.writers.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    segment.mapping.reset();
+    const size_t used = segment.committed.load(std::memory_order_acquire);
+    const std::string path = segment.index ? LogRotation::rotated_path(_filename, segment.index) : _filename;
+    if (::truncate(path.c_str(), static_cast<off_t>(used)) == -1) {
+      // nothing to report to, the segment keeps its zero tail
+    }
+  }
+
+  void rotate(Segment *full, size_t min_size) {
+    std::lock_guard<std::mutex> lock(_rotate_mutex);
+    if (_current.load(std::memory_order_acquire) != full)
+      return; // somebody else rotated already
+    const bool size_reached = full->cursor.load(std::memory_order_relaxed) + min_size > full->capacity;
+    const bool time_reached = _rotation.has_interval() && std::chrono::system_clock::now() >= next_rotation_time();
+    if (!size_reached && !(time_reached && full->committed.load(std::memory_order_acquire))) {
+      if (time_reached) // empty segment, it just starts the next interval
+        set_next_rotation();
+      return;
+    }
+
+    // the mapping stays valid after rename, late writers of the old segment still land in the right file
+    full->index = ++_rotated;
+    _rotation.retire(_filename, full->index);
+    std::unique_ptr<Segment> next;
+    try {
+      next = map_segment(std::max(_segment_size, min_size));
+    } catch (const std::system_error &) {
+      _broken.store(true, std::memory_order_release);
+      return;
+    }
+    _current.store(next.get(), std::memory_order_seq_cst);
+    _segments.push_back(std::move(next));
+    finish(*full);
+  }
+
+  std::string _filename;
+  size_t _segment_size = default_segment_size;
+  LogRotation _rotation;
+  size_t _rotated = 0;
+  std::atomic<std::chrono::system_clock::rep> _next_rotation{0};
+  std::atomic<bool> _broken{false};
+
+  std::mutex _rotate_mutex;
+  std::atomic<Segment *> _current{nullptr};
+  // retired segments stay allocated (unmapped) until close(), a writer may still hold a pointer to them
+  std::vector<std::unique_ptr<Segment>> _segments;
+};
+
+} // namespace common_util
@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace common_util {
+
+/*
+Builds the "[timestamp] [thread id] [SEVERITY] " prefix of a log line straight into the line buffer.
+localtime_r/strftime run once per second per thread, in between only the milliseconds get patched in. The thread id
+is formatted once per thread. Nothing in here allocates once the target string has capacity.
+*/
+class LogPrefix final {
+public:
+  // "2024-01-31 23:59:59.123"
+  static constexpr size_t timestamp_size = 23;
+
+  LogPrefix() = delete;
+
+  // writes timestamp_size chars of local time with milliseconds
+  static void write_timestamp(char *out, std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) {
+    struct SecondCache {
+      std::time_t second = -1;
+      char text[timestamp_size - 4]; // date and time without ".mmm"
+    };
+    static thread_local SecondCache cache;
+
+    const auto since_epoch = now.time_since_epoch();
+    const std::time_t second = std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+    const int64_t milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count() % 1000;
+    if (second != cache.second) {
+      std::tm tm;
+      localtime_r(&second, &tm);
+      char text[sizeof(cache.text) + 1];
+      std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+      std::memcpy(cache.text, text, sizeof(cache.text));
+      cache.second = second;
+    }
+    std::memcpy(out, cache.text, sizeof(cache.text));
+    out += sizeof(cache.text);
+    out[0] = '.';
+    out[1] = static_cast<char>('0' + milliseconds / 100);
+    out[2] = static_cast<char>('0' + milliseconds / 10 % 10);
+    out[3] = static_cast<char>('0' + milliseconds % 10);
+  }
+
+  // std::this_thread::get_id() as decimal text, formatted on the first call of each thread
+  static std::string_view this_thread_id() {
+    static thread_local const std::string thread_id = [] {
+      std::ostringstream string_stream;
+      string_stream << std::dec << std::this_thread::get_id();
+      return string_stream.str();
+    }();
+    return thread_id;
+  }
+
+  static void append(std::string &line, std::string_view timestamp, std::string_view thread_id,
+                     std::string_view severity) {
+    line.push_back('[');
+    line.append(timestamp);
+    line.append("] [", 3);
+    line.append(thread_id);
+    line.append("] [", 3);
+    line.append(severity);
+    line.append("] ", 2);
+  }
+};
+
+} // namespace common_util
@@ -0,0 +1,233 @@
+#pragma once
+#include "log_file.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace common_util {
+
+enum class LogSeverity {
+  DEBUG,
+  INFO,
+  WARNING,
+  ERROR,
+};
+
+constexpr std::string_view log_severity_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+constexpr std::string_view log_severity_name(const LogSeverity severity) {
+  const auto index = static_cast<size_t>(severity);
+  return index < std::size(log_severity_names) ? log_severity_names[index] : std::string_view("NONE");
+}
+
+/*
+Destination of finished log lines. Every sink has its own severity filter, batch size and flush interval:
+  - batch size: lines collected before they're handed to the output in one go, 1 writes every line right away.
+  - flush interval: collected lines don't wait longer than this, Logger's background thread checks it.
+    0 leaves them until the batch is full or flush() is called.
+Sinks lock themselves, one slow sink doesn't hold the lock of another.
+*/
+class LogSink {
+public:
+  explicit LogSink(LogSeverity severity = LogSeverity::DEBUG, size_t batch_size = 1,
+                   std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0))
+      : _severity(severity), _batch_size(batch_size ? batch_size : 1), _flush_interval(flush_interval) {}
+  virtual ~LogSink() = default;
+
+  bool accepts(LogSeverity severity) const { return severity >= _severity.load(std::memory_order_relaxed); }
+  void set_severity(LogSeverity severity) { _severity.store(severity, std::memory_order_relaxed); }
+
+  void set_batch_size(size_t batch_size) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _batch_size = batch_size ? batch_size : 1;
+  }
+  size_t get_batch_size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _batch_size;
+  }
+
+  void set_flush_interval(std::chrono::milliseconds flush_interval) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _flush_interval = flush_interval;
+  }
+  std::chrono::milliseconds get_flush_interval() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _flush_interval;
+  }
+
+  // line ends with a new line
+  virtual void write(std::string_view line, LogSeverity severity) {
+    if (!accepts(severity))
+      return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    append(line, severity);
+    if (++_pending >= _batch_size)
+      commit_pending();
+  }
+
+  // hands out lines which waited for flush interval or longer
+  void flush_if_due(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_pending && _flush_interval.count() && now - _last_commit >= _flush_interval)
+      commit_pending();
+  }
+
+  virtual void flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_pending)
+      commit_pending();
+  }
+
+  virtual void close() { flush(); }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  LogSink(const LogSink &) = delete;
+  LogSink &operator=(const LogSink &) = delete;
+  LogSink(LogSink &&) = delete;
+  LogSink &operator=(LogSink &&) = delete;
+
+protected:
+  // collect one line, _mutex held
+  virtual void append(std::string_view line, LogSeverity severity) = 0;
+  // hand everything collected to the output, _mutex held
+  virtual void commit() = 0;
+
+  std::mutex _mutex;
+
+private:
+  void commit_pending() {
+    commit();
+    _pending = 0;
+    _last_commit = std::chrono::steady_clock::now();
+  }
+
+  std::atomic<LogSeverity> _severity;
+  size_t _batch_size;
+  std::chrono::milliseconds _flush_interval;
+  size_t _pending = 0;
+  std::chrono::steady_clock::time_point _last_commit = std::chrono::steady_clock::now();
+};
+
+// stdout, WARNING and ERROR go to stderr
+class ConsoleSink final : public LogSink {
+public:
+  using LogSink::LogSink;
+  ~ConsoleSink() override { close(); }
+
+protected:
+  void append(std::string_view line, LogSeverity severity) override {
+    (severity >= LogSeverity::WARNING ? _stderr_buffer : _stdout_buffer).append(line);
+  }
+
+  void commit() override {
+    if (!_stdout_buffer.empty())
+      write_fully(STDOUT_FILENO, _stdout_buffer.data(), _stdout_buffer.size());
+    if (!_stderr_buffer.empty())
+      write_fully(STDERR_FILENO, _stderr_buffer.data(), _stderr_buffer.size());
+    _stdout_buffer.clear();
+    _stderr_buffer.clear();
+  }
+
+private:
+  std::string _stdout_buffer;
+  std::string _stderr_buffer;
+};
+
+// LogFile, a batch goes out with one write and is never split over a rotation
+class FileSink final : public LogSink {
+public:
+  // throws std::system_error if the file can't be opened
+  explicit FileSink(const std::string &filename, const LogRotation &rotation = {},
+                    LogSeverity severity = LogSeverity::DEBUG, size_t batch_size = 1,
+                    std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0))
+      : LogSink(severity, batch_size, flush_interval) {
+    _file.open(filename, rotation);
+  }
+  ~FileSink() override { close(); }
+
+  void close() override {
+    LogSink::close();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _file.close();
+  }
+
+protected:
+  void append(std::string_view line, LogSeverity) override { _buffer.append(line); }
+
+  void commit() override {
+    _file.write(_buffer);
+    _buffer.clear();
+  }
+
+private:
+  LogFile _file;
+  std::string _buffer;
+};
+
+// MappedLogFile, lines are copied into the mapping without the sink lock so batching has nothing to save
+class MappedFileSink final : public LogSink {
+public:
+  // throws std::system_error if the first segment can't be mapped
+  explicit MappedFileSink(const std::string &filename, size_t segment_size = MappedLogFile::default_segment_size,
+                          const LogRotation &rotation = {}, LogSeverity severity = LogSeverity::DEBUG)
+      : LogSink(severity) {
+    _file.open(filename, segment_size, rotation);
+  }
+  ~MappedFileSink() override { close(); }
+
+  void write(std::string_view line, LogSeverity severity) override {
+    if (accepts(severity))
+      _file.write(line.data(), line.size());
+  }
+
+  void flush() override {}
+
+  // no writer may run concurrently with close()
+  void close() override { _file.close(); }
+
+protected:
+  void append(std::string_view, LogSeverity) override {}
+  void commit() override {}
+
+private:
+  MappedLogFile _file;
+};
+
+// keeps the last capacity lines in memory, meant for tests
+class MemorySink final : public LogSink {
+public:
+  explicit MemorySink(size_t capacity, LogSeverity severity = LogSeverity::DEBUG)
+      : LogSink(severity), _lines(capacity ? capacity : 1) {}
+
+  // oldest first, lines keep their new line
+  std::vector<std::string> lines() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> result;
+    const size_t count = _written < _lines.size() ? _written : _lines.size();
+    result.reserve(count);
+    for (size_t i = _written - count; i < _written; ++i)
+      result.push_back(_lines[i % _lines.size()]);
+    return result;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _written = 0;
+  }
+
+protected:
+  void append(std::string_view line, LogSeverity) override { _lines[_written++ % _lines.size()].assign(line); }
+  void commit() override {}
+
+private:
+  std::vector<std::string> _lines;
+  size_t _written = 0;
+};
+
+} // namespace common_util
@@ -1,21 +1,48 @@
 #pragma once
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <fcntl.h>
 #include <filesystem>
 #include <ios>
+#include <iterator>
 #include <iostream>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <system_error>
+#include <type_traits>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace common_util {
 
+/*
+How RMemoryMapped sets up its mapping. Defaults are a plain mmap, pages get faulted in on first touch.
+  - populate: MAP_POPULATE, the whole file is read and mapped before the constructor returns (no page faults later).
+  - huge_pages: TRANSPARENT asks for transparent huge pages with MADV_HUGEPAGE (a hint, needs kernel support for
+    file backed THP), EXPLICIT maps with MAP_HUGETLB which only works for files on hugetlbfs.
+  - lock: mlock the mapping, pages stay resident. Limited by RLIMIT_MEMLOCK.
+  - access: madvise hint for the whole mapping, SEQUENTIAL reads ahead aggressively and drops pages behind,
+    RANDOM turns read ahead off, WILLNEED starts reading the file in the background.
+Setting up the mapping fails with std::system_error if the kernel refuses one of them.
+*/
+struct MapPolicy {
+  enum class HugePages { NONE, TRANSPARENT, EXPLICIT };
+  enum class Access { NORMAL, SEQUENTIAL, RANDOM, WILLNEED };
+
+  bool populate = false;
+  HugePages huge_pages = HugePages::NONE;
+  bool lock = false;
+  Access access = Access::NORMAL;
+};
+
 template <typename T> class RMemoryMapped final {
 public:
-  RMemoryMapped(const std::filesystem::path &path) : filePath(path) {
+  RMemoryMapped(const std::filesystem::path &path, const MapPolicy &policy = {}) : filePath(path) {
     // Open file in read only
     file = open(filePath.c_str(), O_RDONLY);
     if (file == -1) {
@@ -25,22 +52,54 @@ public:
 
     // get size of the file
     if (fstat(file, &sb) == -1)
-      throw std::system_error(errno, std::iostream_category(), "Can't get size of file");
+      fail("Can't get size of file");
     // file size in bytes
     _size = sb.st_size;
 
     /*
      * maps the file into virtual memory ref (The Linux Programming Interface 49.2 Creating a Mapping: mmap())
      */
-    _begin = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, file, 0);
-    if (_begin == MAP_FAILED)
-      throw std::system_error(errno, std::iostream_category(), "Can't map file");
+    int flags = MAP_PRIVATE;
+    if (policy.populate)
+      flags |= MAP_POPULATE;
+    if (policy.huge_pages == MapPolicy::HugePages::EXPLICIT)
+      flags |= MAP_HUGETLB;
+    _begin = mmap(NULL, _size, PROT_READ, flags, file, 0);
+    if (_begin == MAP_FAILED) {
+      _begin = nullptr;
+      fail("Can't map file");
+    }
     file_begin = static_cast<T *>(_begin);
+
+    if (policy.huge_pages == MapPolicy::HugePages::TRANSPARENT && madvise(_begin, _size, MADV_HUGEPAGE) == -1)
+      fail("Can't use transparent huge pages");
+    if (policy.access != MapPolicy::Access::NORMAL && madvise(_begin, _size, access_advice(policy.access)) == -1)
+      fail("Can't set access pattern of mapping");
+    if (policy.lock) {
+      if (mlock(_begin, _size) == -1)
+        fail("Can't lock mapping in memory");
+      _locked = true;
+    }
   }
   T *begin() { return file_begin; }
   T *end() { return file_begin + _size / sizeof(T); }
   size_t size() { return _size / sizeof(T); }
+
+  // changes the access hint of [from, to), e.g. RANDOM for an index part of a file that's scanned otherwise
+  void advise(const T *from, const T *to, MapPolicy::Access access) {
+    advise_pages(from, to, access_advice(access), false);
+  }
+
+  /*
+  MADV_DONTNEED on a consumed range: its pages leave this process' resident set right away, reading them again
+  faults them back in from the page cache or the file. Only pages completely inside [from, to) are released.
+  */
+  void release(const T *from, const T *to) { advise_pages(from, to, MADV_DONTNEED, true); }
+
   ~RMemoryMapped() {
+    if (_locked) {
+      munlock(_begin, _size);
+    }
     if (_begin) {
       munmap(_begin, _size);
     }
@@ -55,13 +114,57 @@ public:
   RMemoryMapped &operator=(const RMemoryMapped &) = delete;
 
 private:
+  static int access_advice(MapPolicy::Access access) {
+    switch (access) {
+    case MapPolicy::Access::SEQUENTIAL:
+      return MADV_SEQUENTIAL;
+    case MapPolicy::Access::RANDOM:
+      return MADV_RANDOM;
+    case MapPolicy::Access::WILLNEED:
+      return MADV_WILLNEED;
+    default:
+      return MADV_NORMAL;
+    }
+  }
+
+  // the destructor doesn't run for a throwing constructor, undo the mapping and the open before throwing
+  [[noreturn]] void fail(const char *message) {
+    const int error = errno;
+    if (_begin)
+      munmap(_begin, _size);
+    close(file);
+    throw std::system_error(error, std::iostream_category(), message);
+  }
+
+  // madvise needs a page aligned start, inner keeps partly covered pages at both ends out
+  void advise_pages(const T *from, const T *to, int advice, bool inner) {
+    static const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t first = reinterpret_cast<uintptr_t>(from);
+    uintptr_t last = reinterpret_cast<uintptr_t>(to);
+    first = inner ? (first + page_size - 1) & ~(page_size - 1) : first & ~(page_size - 1);
+    if (inner && to != end())
+      last &= ~(page_size - 1);
+    if (last <= first)
+      return;
+    if (madvise(reinterpret_cast<void *>(first), last - first, advice) == -1)
+      throw std::system_error(errno, std::iostream_category(), "Can't advise kernel about mapping");
+  }
+
   std::filesystem::path filePath;
   int file = -1;
   std::size_t _size;
-  void *_begin;
+  void *_begin = nullptr;
   T *file_begin;
+  bool _locked = false;
 };
 
+/*
+Writable mapping of a file with a size fixed at construction.
+Writes made through write() or announced with mark_dirty() are tracked as page ranges. flush_async() starts
+writeback of just those ranges and returns, checkpoint() waits until everything written so far is on disk. flush()
+still syncs the whole mapping, for writes that went through begin() without mark_dirty().
+Not thread safe.
+*/
 template <typename T> class WMemoryMapped final {
 public:
   WMemoryMapped(const std::filesystem::path &path, size_t size) : filePath(path), _size(size) {
@@ -89,6 +192,69 @@ public:
     if (msync(_begin, _size, MS_SYNC) == -1) {
       throw std::system_error(errno, std::iostream_category(), "Memory failed to flush in file");
     }
+    _dirty.clear();
+    _written_back.clear();
+  }
+
+  // copies count elements to index and marks them dirty
+  void write(size_t index, const T *data, size_t count) {
+    std::memcpy(file_begin + index, data, count * sizeof(T));
+    mark_dirty(index, count);
+  }
+  void write(size_t index, const T &value) { write(index, &value, 1); }
+
+  // elements [index, index + count) were changed through begin()
+  void mark_dirty(size_t index, size_t count) {
+    if (!count)
+      return;
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t first = index * sizeof(T) / page_size * page_size;
+    const size_t last = std::min(_size, ((index + count) * sizeof(T) + page_size - 1) / page_size * page_size);
+    add_range(_dirty, first, last);
+  }
+  void mark_dirty(const T *from, const T *to) {
+    mark_dirty(static_cast<size_t>(from - file_begin), static_cast<size_t>(to - from));
+  }
+
+  // bytes marked dirty since the last flush_async(), whole pages
+  size_t dirty_bytes() const {
+    size_t bytes = 0;
+    for (const auto &range : _dirty)
+      bytes += range.second - range.first;
+    return bytes;
+  }
+
+  /*
+  Starts writeback of the dirty ranges (sync_file_range, msync MS_ASYNC where that isn't supported) and returns
+  without waiting for the disk. The ranges are remembered for the next checkpoint().
+  */
+  void flush_async() {
+    for (const auto &range : _dirty) {
+      if (sync_file_range(file, static_cast<off_t>(range.first), static_cast<off_t>(range.second - range.first),
+                          SYNC_FILE_RANGE_WRITE) == -1 &&
+          msync(static_cast<char *>(_begin) + range.first, range.second - range.first, MS_ASYNC) == -1) {
+        throw std::system_error(errno, std::iostream_category(), "Memory failed to start flush in file");
+      }
+      add_range(_written_back, range.first, range.second);
+    }
+    _dirty.clear();
+  }
+
+  // everything marked dirty or flushed asynchronously so far is on disk when this returns
+  void checkpoint() {
+    flush_async();
+    for (const auto &range : _written_back) {
+      if (sync_file_range(file, static_cast<off_t>(range.first), static_cast<off_t>(range.second - range.first),
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1 &&
+          msync(static_cast<char *>(_begin) + range.first, range.second - range.first, MS_SYNC) == -1) {
+        throw std::system_error(errno, std::iostream_category(), "Memory failed to flush in file");
+      }
+    }
+    // sync_file_range leaves the device cache and file metadata alone
+    if (!_written_back.empty() && fdatasync(file) == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Memory failed to flush in file");
+    }
+    _written_back.clear();
   }
 
   ~WMemoryMapped() {
@@ -107,10 +273,340 @@ public:
   WMemoryMapped &operator=(const WMemoryMapped &&) = delete;
 
 private:
+  // keeps ranges sorted and merged, writers mostly extend the last one
+  static void add_range(std::vector<std::pair<size_t, size_t>> &ranges, size_t first, size_t last) {
+    if (!ranges.empty() && first >= ranges.back().first) {
+      if (first <= ranges.back().second)
+        ranges.back().second = std::max(ranges.back().second, last);
+      else
+        ranges.emplace_back(first, last);
+      return;
+    }
+    // ranges are disjoint, so their ends are sorted too. Merge every range that overlaps or touches [first, last)
+    const auto ends_before = [](const std::pair<size_t, size_t> &range, size_t value) { return range.second < value; };
+    auto begin = std::lower_bound(ranges.begin(), ranges.end(), first, ends_before);
+    auto end = begin;
+    for (; end != ranges.end() && end->first <= last; ++end) {
+      first = std::min(first, end->first);
+      last = std::max(last, end->second);
+    }
+    ranges.insert(ranges.erase(begin, end), {first, last});
+  }
+
   std::filesystem::path filePath;
   int file = -1;
   std::size_t _size;
   void *_begin;
   T *file_begin;
+  std::vector<std::pair<size_t, size_t>> _dirty;        // [first, last) bytes, page aligned
+  std::vector<std::pair<size_t, size_t>> _written_back; // writeback started, not waited for yet
+};
+
+/*
+Append only memory mapped writer for files of unknown final size. The file grows geometrically: ftruncate makes it
+longer and mremap extends the mapping, the kernel moves page table entries instead of copying what's already written.
+close() (or the destructor) cuts the file down to the appended elements.
+Pointers into the mapping (begin(), end()) are invalidated whenever an append has to grow the file.
+*/
+template <typename T> class AMemoryMapped final {
+  static_assert(std::is_trivially_copyable_v<T>, "AMemoryMapped stores raw bytes of T");
+
+public:
+  static constexpr size_t default_capacity = 1 << 20; // bytes
+
+  // capacity in bytes is only the first guess, rounded up to whole pages
+  AMemoryMapped(const std::filesystem::path &path, size_t capacity = default_capacity) : filePath(path) {
+    file = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, (mode_t)0600);
+    if (file == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Can't open file to append");
+    }
+    _capacity = round_to_page(capacity ? capacity : default_capacity);
+    if (ftruncate(file, _capacity) == -1) {
+      const int error = errno;
+      ::close(file);
+      throw std::system_error(error, std::iostream_category(), "Can't truncate size of file to append");
+    }
+    _begin = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (_begin == MAP_FAILED) {
+      const int error = errno;
+      ::close(file);
+      throw std::system_error(error, std::iostream_category(), "Can't memory map file to append");
+    }
+  }
+
+  void append(const T &value) { append(&value, 1); }
+
+  void append(const T *data, size_t count) {
+    if (file == -1)
+      throw std::system_error(EBADF, std::iostream_category(), "Append to closed file");
+    const size_t bytes = count * sizeof(T);
+    if (_size + bytes > _capacity)
+      grow(_size + bytes);
+    std::memcpy(static_cast<char *>(_begin) + _size, data, bytes);
+    _size += bytes;
+  }
+
+  // contiguous ranges of T: std::vector, std::array, std::basic_string_view ... (C++17 has no std::span)
+  template <typename Range, typename = decltype(std::declval<const Range &>().data())>
+  void append(const Range &range) {
+    append(range.data(), range.size());
+  }
+
+  // nullptr after close()
+  T *begin() { return static_cast<T *>(_begin); }
+  T *end() { return _begin ? begin() + size() : nullptr; }
+  // appended elements
+  size_t size() const { return _size / sizeof(T); }
+  // mapped bytes, the file is this long until close()
+  size_t capacity() const { return _capacity; }
+
+  void flush() {
+    if (_size && msync(_begin, _size, MS_SYNC) == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Memory failed to flush in file");
+    }
+  }
+
+  // unmaps and truncates the file to size(), later appends throw std::system_error (EBADF)
+  void close() {
+    if (!release())
+      throw std::system_error(errno, std::iostream_category(), "Can't truncate appended file to its size");
+  }
+
+  ~AMemoryMapped() { release(); }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  AMemoryMapped(const AMemoryMapped &) = delete;
+  AMemoryMapped &operator=(const AMemoryMapped &) = delete;
+  AMemoryMapped(AMemoryMapped &&) = delete;
+  AMemoryMapped &operator=(AMemoryMapped &&) = delete;
+
+private:
+  static size_t round_to_page(size_t bytes) {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (bytes + page_size - 1) / page_size * page_size;
+  }
+
+  void grow(size_t required) {
+    size_t capacity = _capacity;
+    while (capacity < required)
+      capacity *= 2;
+    if (ftruncate(file, capacity) == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Can't grow file to append");
+    }
+    void *begin = mremap(_begin, _capacity, capacity, MREMAP_MAYMOVE);
+    if (begin == MAP_FAILED) {
+      throw std::system_error(errno, std::iostream_category(), "Can't grow memory map to append");
+    }
+    _begin = begin;
+    _capacity = capacity;
+  }
+
+  bool release() {
+    if (file == -1)
+      return true;
+    munmap(_begin, _capacity);
+    _begin = nullptr;
+    _capacity = 0;
+    const bool truncated = ftruncate(file, _size) != -1;
+    const int error = errno;
+    ::close(file);
+    file = -1;
+    errno = error;
+    return truncated;
+  }
+
+  std::filesystem::path filePath;
+  int file = -1;
+  std::size_t _size = 0;     // bytes
+  std::size_t _capacity = 0; // bytes
+  void *_begin = nullptr;
 };
-} // namespace common_util
\ No newline at end of file
+
+/*
+Streaming reader for files larger than RAM, only a fixed size window of the file is mapped at a time.
+Records are read front to back and may cross window boundaries: every window maps an extra sizeof(T) (rounded up to
+a page) past its end, so a record starting in a window is always complete in it. While the cursor is in window k,
+window k + 1 is already mapped with MADV_WILLNEED and read in the background. Leaving window k drops its pages with
+MADV_DONTNEED and from the page cache with POSIX_FADV_DONTNEED, resident memory stays below
+2 * (window_bytes + sizeof(T) rounded up to pages).
+  common_util::SMemoryMapped<Trade> trades("trades.bin", 256 << 20);
+  for (const Trade &trade : trades)
+    process(trade);
+*/
+template <typename T> class SMemoryMapped final {
+  static_assert(std::is_trivially_copyable_v<T>, "SMemoryMapped reads raw bytes of T");
+
+  struct Window {
+    size_t index = static_cast<size_t>(-1);
+    void *base = nullptr;
+    size_t offset = 0; // in file, bytes
+    size_t length = 0; // mapped bytes
+  };
+
+public:
+  static constexpr size_t default_window_bytes = 64 << 20;
+
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    iterator() = default;
+    explicit iterator(SMemoryMapped *reader) : _reader(reader), _record(reader->next()) {}
+    reference operator*() const { return *_record; }
+    pointer operator->() const { return _record; }
+    iterator &operator++() {
+      _record = _reader->next();
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return _record == other._record; }
+    bool operator!=(const iterator &other) const { return _record != other._record; }
+
+  private:
+    SMemoryMapped *_reader = nullptr;
+    const T *_record = nullptr;
+  };
+
+  // window_bytes is rounded up to whole pages
+  SMemoryMapped(const std::filesystem::path &path, size_t window_bytes = default_window_bytes, bool drop_cache = true)
+      : filePath(path), _drop_cache(drop_cache) {
+    file = open(filePath.c_str(), O_RDONLY);
+    if (file == -1) {
+      throw std::system_error(errno, std::iostream_category(), "Can't open file to read :- ");
+    }
+    struct stat sb;
+    if (fstat(file, &sb) == -1) {
+      const int error = errno;
+      ::close(file);
+      throw std::system_error(error, std::iostream_category(), "Can't get size of file");
+    }
+    _file_size = sb.st_size;
+    _size = _file_size / sizeof(T);
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    _window_bytes = std::max(page_size, (window_bytes + page_size - 1) / page_size * page_size);
+    _overlap_bytes = (sizeof(T) + page_size - 1) / page_size * page_size;
+  }
+
+  // records in the file
+  size_t size() const { return _size; }
+  // records handed out so far
+  size_t position() const { return _position; }
+
+  /*
+  Next record, nullptr at the end of the file. The pointer stays valid until the next call of next() or next_batch().
+  */
+  const T *next() {
+    if (!_batch_left && !load_batch())
+      return nullptr;
+    --_batch_left;
+    ++_position;
+    return _batch++;
+  }
+
+  /*
+  Up to max_records following records, contiguous in memory. Fewer are returned at the end of a window, an empty
+  batch means end of file. Valid until the next call of next() or next_batch().
+  */
+  std::pair<const T *, size_t> next_batch(size_t max_records = static_cast<size_t>(-1)) {
+    if (!_batch_left && !load_batch())
+      return {nullptr, 0};
+    const size_t count = std::min(max_records, _batch_left);
+    const T *batch = _batch;
+    _batch += count;
+    _batch_left -= count;
+    _position += count;
+    return {batch, count};
+  }
+
+  // reads from the current position on, a reader can be iterated once
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+  ~SMemoryMapped() {
+    unmap(_current, false);
+    unmap(_ahead, false);
+    if (file != -1) {
+      ::close(file);
+    }
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  SMemoryMapped(const SMemoryMapped &) = delete;
+  SMemoryMapped &operator=(const SMemoryMapped &) = delete;
+  SMemoryMapped(SMemoryMapped &&) = delete;
+  SMemoryMapped &operator=(SMemoryMapped &&) = delete;
+
+private:
+  // first record starting at or after byte
+  size_t first_record(size_t byte) const { return std::min(_size, (byte + sizeof(T) - 1) / sizeof(T)); }
+
+  // records starting in the window of _position, moves the windows forward when the cursor left the current one
+  bool load_batch() {
+    if (_position >= _size)
+      return false;
+    const size_t index = _position * sizeof(T) / _window_bytes;
+    if (index != _current.index) {
+      unmap(_current, true);
+      if (_ahead.index == index)
+        std::swap(_current, _ahead);
+      else
+        map(_current, index);
+      if (_ahead.index != index + 1) {
+        unmap(_ahead, false);
+        if ((index + 1) * _window_bytes < _file_size)
+          map(_ahead, index + 1);
+      }
+    }
+    const size_t last = first_record((index + 1) * _window_bytes);
+    _batch = reinterpret_cast<const T *>(static_cast<const char *>(_current.base) +
+                                         (_position * sizeof(T) - _current.offset));
+    _batch_left = last - _position;
+    return true;
+  }
+
+  void map(Window &window, size_t index) {
+    window.index = index;
+    window.offset = index * _window_bytes;
+    window.length = std::min(_window_bytes + _overlap_bytes, _file_size - window.offset);
+    window.base = mmap(nullptr, window.length, PROT_READ, MAP_PRIVATE, file, static_cast<off_t>(window.offset));
+    if (window.base == MAP_FAILED) {
+      window = Window();
+      throw std::system_error(errno, std::iostream_category(), "Can't map window of file");
+    }
+    // hints only, the read works without them
+    madvise(window.base, window.length, MADV_SEQUENTIAL);
+    madvise(window.base, window.length, MADV_WILLNEED);
+  }
+
+  void unmap(Window &window, bool consumed) {
+    if (!window.base)
+      return;
+    if (consumed) {
+      madvise(window.base, window.length, MADV_DONTNEED);
+      // the overlap belongs to the next window, keep it cached
+      if (_drop_cache)
+        posix_fadvise(file, static_cast<off_t>(window.offset), static_cast<off_t>(_window_bytes),
+                      POSIX_FADV_DONTNEED);
+    }
+    munmap(window.base, window.length);
+    window = Window();
+  }
+
+  std::filesystem::path filePath;
+  int file = -1;
+  bool _drop_cache;
+  size_t _file_size = 0;     // bytes
+  size_t _size = 0;          // records
+  size_t _window_bytes = 0;  // distance between window starts
+  size_t _overlap_bytes = 0; // mapped past the window end
+  size_t _position = 0;      // records handed out
+  Window _current;
+  Window _ahead;
+  const T *_batch = nullptr;
+  size_t _batch_left = 0;
+};
+
+} // namespace common_util
@@ -0,0 +1,429 @@
+#pragma once
+#include "Logger.hpp"
+#include "memory_map_util.hpp"
+#include "string_format_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace common_util {
+
+enum class MetricType : uint8_t { COUNTER, GAUGE };
+
+// one metric in a snapshot, counters wrap into int64_t past 2^63
+struct MetricValue {
+  std::string name;
+  MetricType type;
+  int64_t value;
+};
+
+namespace metrics_detail {
+
+// power of two, more shards than threads only costs snapshot time
+constexpr size_t counter_shards = 16;
+
+struct alignas(64) CounterShard {
+  std::atomic<uint64_t> value{0};
+};
+
+// shard of the calling thread, threads are spread round robin
+inline size_t thread_shard() {
+  static std::atomic<size_t> next_shard{0};
+  static thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % counter_shards;
+  return shard;
+}
+
+} // namespace metrics_detail
+
+/*
+Monotonic count, e.g. rows parsed. add() is one relaxed fetch_add on a cache line shared only with the threads
+sharing its shard, value() sums the shards.
+*/
+class Counter final {
+public:
+  explicit Counter(std::string_view name) : _name(name) {}
+
+  void add(uint64_t count = 1) {
+    _shards[metrics_detail::thread_shard()].value.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    uint64_t sum = 0;
+    for (const metrics_detail::CounterShard &shard : _shards)
+      sum += shard.value.load(std::memory_order_relaxed);
+    return sum;
+  }
+
+  const std::string &name() const { return _name; }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  Counter(const Counter &) = delete;
+  Counter(Counter &&) = delete;
+  Counter &operator=(const Counter &) = delete;
+  Counter &operator=(Counter &&) = delete;
+
+private:
+  metrics_detail::CounterShard _shards[metrics_detail::counter_shards];
+  std::string _name;
+};
+
+// current level, e.g. bytes mapped. Padded so a busy gauge doesn't slow its neighbours down
+class alignas(64) Gauge final {
+public:
+  explicit Gauge(std::string_view name) : _name(name) {}
+
+  void set(int64_t value) { _value.store(value, std::memory_order_relaxed); }
+  void add(int64_t delta) { _value.fetch_add(delta, std::memory_order_relaxed); }
+  void sub(int64_t delta) { _value.fetch_sub(delta, std::memory_order_relaxed); }
+  int64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+  const std::string &name() const { return _name; }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  Gauge(const Gauge &) = delete;
+  Gauge(Gauge &&) = delete;
+  Gauge &operator=(const Gauge &) = delete;
+  Gauge &operator=(Gauge &&) = delete;
+
+private:
+  std::atomic<int64_t> _value{0};
+  std::string _name;
+};
+
+/*
+Named counters and gauges. Looking a metric up takes a lock, keep the reference (it stays valid for the registry's
+lifetime) and update through it without one.
+  static common_util::Counter &rows_parsed = common_util::MetricsRegistry::get_instance().counter("rows_parsed");
+  rows_parsed.add(block.size());
+*/
+class MetricsRegistry final {
+public:
+  static MetricsRegistry &get_instance() {
+    static MetricsRegistry instance;
+    return instance;
+  }
+
+  MetricsRegistry() = default;
+
+  // the same name gives the same counter. Throws std::invalid_argument if name is a gauge
+  Counter &counter(std::string_view name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters[find_or_add(name, MetricType::COUNTER)];
+  }
+
+  // the same name gives the same gauge. Throws std::invalid_argument if name is a counter
+  Gauge &gauge(std::string_view name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _gauges[find_or_add(name, MetricType::GAUGE)];
+  }
+
+  // every metric in registration order. Each value is read once, relaxed, the set isn't one atomic cut
+  std::vector<MetricValue> snapshot() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<MetricValue> values;
+    values.reserve(_order.size());
+    for (const auto &[type, index] : _order) {
+      if (type == MetricType::COUNTER)
+        values.push_back({_counters[index].name(), type, static_cast<int64_t>(_counters[index].value())});
+      else
+        values.push_back({_gauges[index].name(), type, _gauges[index].value()});
+    }
+    return values;
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MetricsRegistry(const MetricsRegistry &) = delete;
+  MetricsRegistry(MetricsRegistry &&) = delete;
+  MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+  MetricsRegistry &operator=(MetricsRegistry &&) = delete;
+
+private:
+  size_t find_or_add(std::string_view name, MetricType type) {
+    const auto found = _indexes.find(std::string(name));
+    if (found != _indexes.end()) {
+      if (_order[found->second].first != type)
+        throw std::invalid_argument("Metric registered with another type :- " + std::string(name));
+      return _order[found->second].second;
+    }
+    const size_t index = type == MetricType::COUNTER ? _counters.size() : _gauges.size();
+    if (type == MetricType::COUNTER)
+      _counters.emplace_back(name);
+    else
+      _gauges.emplace_back(name);
+    _indexes.emplace(std::string(name), _order.size());
+    _order.emplace_back(type, index);
+    return index;
+  }
+
+  mutable std::mutex _mutex;
+  // deques never move their elements, references handed out stay valid
+  std::deque<Counter> _counters;
+  std::deque<Gauge> _gauges;
+  std::vector<std::pair<MetricType, size_t>> _order;
+  std::unordered_map<std::string, size_t> _indexes;
+};
+
+/*
+Mapped snapshot file a scraper on the same host reads in place, no sockets, no parsing:
+  header (64 bytes)  char magic[8] "CUMETR01", uint32_t capacity, uint32_t count, uint64_t sequence,
+                     int64_t time_ns (CLOCK_REALTIME of the snapshot), zero padding
+  entry i (64 bytes) at 64 + i * 64: char name[55] (NUL padded, longer names cut), uint8_t type (MetricType),
+                     int64_t value
+Host byte order. sequence is a seqlock: odd while a snapshot is written, a reader copies the entries and retries if
+sequence was odd or changed meanwhile (MetricsFileReader does that).
+*/
+namespace metrics_file {
+constexpr char magic[8] = {'C', 'U', 'M', 'E', 'T', 'R', '0', '1'};
+constexpr size_t header_size = 64;
+constexpr size_t entry_size = 64;
+constexpr size_t name_size = 55;
+constexpr size_t capacity_offset = 8;
+constexpr size_t count_offset = 12;
+constexpr size_t sequence_offset = 16;
+constexpr size_t time_offset = 24;
+constexpr size_t type_offset = 55;
+constexpr size_t value_offset = 56;
+} // namespace metrics_file
+
+/*
+Writes snapshots into a mapped file of capacity entries, metrics past capacity are left out. The file isn't synced to
+disk, readers see it through the page cache.
+A new file is created with mode (0644 by default, less the umask) so scrapers running as another user can read it.
+An existing metrics file of the same capacity is reused as it is, without truncation, so a restarted writer doesn't
+pull the mapping out from under a scraper; it keeps its owner and mode. Any other existing file is resized and
+overwritten. Not thread safe, one writer per file.
+*/
+class MetricsFileWriter final {
+public:
+  explicit MetricsFileWriter(const std::filesystem::path &path, uint32_t capacity = 256, mode_t mode = 0644)
+      : _size(metrics_file::header_size + size_t(capacity) * metrics_file::entry_size), _capacity(capacity) {
+    _file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, mode);
+    if (_file == -1)
+      throw std::system_error(errno, std::iostream_category(), "Can't open metrics file :- " + path.string());
+    struct stat sb;
+    if (fstat(_file, &sb) == -1)
+      fail("Can't get size of metrics file");
+    const bool resize = static_cast<size_t>(sb.st_size) != _size;
+    if (resize && ftruncate(_file, static_cast<off_t>(_size)) == -1)
+      fail("Can't size metrics file");
+    void *mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+    if (mapping == MAP_FAILED)
+      fail("Can't map metrics file");
+    _header = static_cast<char *>(mapping);
+
+    uint32_t existing_capacity = 0;
+    std::memcpy(&existing_capacity, _header + metrics_file::capacity_offset, sizeof(existing_capacity));
+    if (resize || std::memcmp(_header, metrics_file::magic, sizeof(metrics_file::magic)) != 0 ||
+        existing_capacity != capacity) {
+      std::memset(_header, 0, metrics_file::header_size);
+      std::memcpy(_header, metrics_file::magic, sizeof(metrics_file::magic));
+      std::memcpy(_header + metrics_file::capacity_offset, &capacity, sizeof(capacity));
+    }
+  }
+
+  ~MetricsFileWriter() {
+    munmap(_header, _size);
+    close(_file);
+  }
+
+  void write(const std::vector<MetricValue> &values) {
+    uint64_t *sequence = reinterpret_cast<uint64_t *>(_header + metrics_file::sequence_offset);
+    // odd while writing, a writer that died half way left it odd already
+    const uint64_t current = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+    const uint64_t begin = current + 1 + (current & 1);
+    __atomic_store_n(sequence, begin, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    const uint32_t count = static_cast<uint32_t>(std::min<size_t>(values.size(), _capacity));
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const int64_t time_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    std::memcpy(_header + metrics_file::count_offset, &count, sizeof(count));
+    std::memcpy(_header + metrics_file::time_offset, &time_ns, sizeof(time_ns));
+    for (uint32_t i = 0; i < count; ++i) {
+      char *entry = _header + metrics_file::header_size + i * metrics_file::entry_size;
+      std::memset(entry, 0, metrics_file::name_size);
+      std::memcpy(entry, values[i].name.data(), std::min(values[i].name.size(), metrics_file::name_size));
+      entry[metrics_file::type_offset] = static_cast<char>(values[i].type);
+      std::memcpy(entry + metrics_file::value_offset, &values[i].value, sizeof(int64_t));
+    }
+    __atomic_store_n(sequence, begin + 1, __ATOMIC_RELEASE);
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MetricsFileWriter(const MetricsFileWriter &) = delete;
+  MetricsFileWriter(MetricsFileWriter &&) = delete;
+  MetricsFileWriter &operator=(const MetricsFileWriter &) = delete;
+  MetricsFileWriter &operator=(MetricsFileWriter &&) = delete;
+
+private:
+  // the destructor doesn't run for a throwing constructor
+  [[noreturn]] void fail(const char *message) {
+    const int error = errno;
+    close(_file);
+    throw std::system_error(error, std::iostream_category(), message);
+  }
+
+  size_t _size;
+  uint32_t _capacity;
+  int _file = -1;
+  char *_header = nullptr;
+};
+
+/*
+Scraper side of a MetricsFileWriter file, maps it once and reads the latest snapshot on every read().
+Throws std::runtime_error if the file isn't a metrics file, and from read() if no consistent snapshot showed up within
+timeout (a writer that died in the middle of one leaves the file that way until it is restarted).
+  common_util::MetricsFileReader metrics("/dev/shm/orders.metrics");
+  for (const common_util::MetricValue &metric : metrics.read())
+    ...
+*/
+class MetricsFileReader final {
+public:
+  explicit MetricsFileReader(const std::filesystem::path &path,
+                             std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+      : _file(path), _timeout(timeout) {
+    if (_file.size() < metrics_file::header_size ||
+        std::memcmp(_file.begin(), metrics_file::magic, sizeof(metrics_file::magic)) != 0)
+      throw std::runtime_error("Not a metrics file :- " + path.string());
+    std::memcpy(&_capacity, _file.begin() + metrics_file::capacity_offset, sizeof(_capacity));
+    if (_file.size() < metrics_file::header_size + size_t(_capacity) * metrics_file::entry_size)
+      throw std::runtime_error("Metrics file truncated :- " + path.string());
+  }
+
+  // consistent copy of the latest snapshot, retries while the writer is in the middle of one
+  std::vector<MetricValue> read(int64_t *time_ns = nullptr) {
+    const char *header = _file.begin();
+    const uint64_t *sequence = reinterpret_cast<const uint64_t *>(header + metrics_file::sequence_offset);
+    std::vector<MetricValue> values;
+    const auto deadline = std::chrono::steady_clock::now() + _timeout;
+    for (bool first = true;; first = false) {
+      if (!first && std::chrono::steady_clock::now() > deadline)
+        throw std::runtime_error("No consistent snapshot in metrics file, writer stalled");
+      const uint64_t begin = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+      if (begin & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t count;
+      std::memcpy(&count, header + metrics_file::count_offset, sizeof(count));
+      count = std::min(count, _capacity);
+      values.resize(count);
+      for (uint32_t i = 0; i < count; ++i) {
+        const char *entry = header + metrics_file::header_size + i * metrics_file::entry_size;
+        values[i].name.assign(entry, strnlen(entry, metrics_file::name_size));
+        values[i].type = static_cast<MetricType>(entry[metrics_file::type_offset]);
+        std::memcpy(&values[i].value, entry + metrics_file::value_offset, sizeof(int64_t));
+      }
+      if (time_ns)
+        std::memcpy(time_ns, header + metrics_file::time_offset, sizeof(int64_t));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(sequence, __ATOMIC_RELAXED) == begin)
+        return values;
+    }
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MetricsFileReader(const MetricsFileReader &) = delete;
+  MetricsFileReader(MetricsFileReader &&) = delete;
+  MetricsFileReader &operator=(const MetricsFileReader &) = delete;
+  MetricsFileReader &operator=(MetricsFileReader &&) = delete;
+
+private:
+  RMemoryMapped<char> _file;
+  std::chrono::milliseconds _timeout;
+  uint32_t _capacity = 0;
+};
+
+/*
+Background thread that every period snapshots a registry into a Logger (one line, "metrics rows_parsed=10
+bytes_mapped=4096") or into a metrics file. The destructor exports once more.
+  common_util::MetricsExporter exporter(std::chrono::seconds(1), "/dev/shm/orders.metrics");
+*/
+class MetricsExporter final {
+public:
+  MetricsExporter(std::chrono::milliseconds period, Logger &logger, Logger::Severity severity = Logger::Severity::INFO,
+                  MetricsRegistry &registry = MetricsRegistry::get_instance())
+      : MetricsExporter(period, registry, [&logger, severity](const std::vector<MetricValue> &values) {
+          std::string line = "metrics";
+          for (const MetricValue &value : values)
+            line += string_format(" ", value.name, "=", value.value);
+          logger.log(line, severity);
+        }) {}
+
+  MetricsExporter(std::chrono::milliseconds period, const std::filesystem::path &path, uint32_t capacity = 256,
+                  MetricsRegistry &registry = MetricsRegistry::get_instance())
+      : MetricsExporter(period, registry,
+                        [file = std::make_shared<MetricsFileWriter>(path, capacity)](
+                            const std::vector<MetricValue> &values) { file->write(values); }) {}
+
+  ~MetricsExporter() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wakeup.notify_one();
+    _thread.join();
+    export_now();
+  }
+
+  void export_now() {
+    std::lock_guard<std::mutex> lock(_export_mutex);
+    _output(_registry.snapshot());
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter(MetricsExporter &&) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(MetricsExporter &&) = delete;
+
+private:
+  using type_output = std::function<void(const std::vector<MetricValue> &)>;
+
+  MetricsExporter(std::chrono::milliseconds period, MetricsRegistry &registry, type_output output)
+      : _period(period), _registry(registry), _output(std::move(output)),
+        _thread(&MetricsExporter::exporter_loop, this) {}
+
+  void exporter_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_wakeup.wait_for(lock, _period, [this] { return _stop; })) {
+      lock.unlock();
+      export_now();
+      lock.lock();
+    }
+  }
+
+  std::chrono::milliseconds _period;
+  MetricsRegistry &_registry;
+  type_output _output;
+  std::mutex _export_mutex;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  bool _stop = false;
+  // last, the thread starts with everything above constructed
+  std::thread _thread;
+};
+
+} // namespace common_util
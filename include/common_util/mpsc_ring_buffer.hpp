@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace common_util {
+
+/*
+Bounded lock-free ring buffer for many producers and a single consumer.
+Every slot carries a sequence number (Dmitry Vyukov's bounded queue). A producer claims a position with a CAS on the
+enqueue cursor, swaps its value into the slot and publishes it by bumping the slot sequence. The consumer can look at
+several published slots at once and hand them back in one go, so it can batch without copying values out.
+
+Values are swapped (not copied) in and out, the producer gets back whatever the slot held before. With types like
+std::string this recycles buffers between producers and consumer instead of allocating per element.
+Capacity is rounded up to a power of two.
+*/
+template <typename T> class MPSCRingBuffer final {
+  static constexpr size_t cache_line_size = 64;
+
+  struct alignas(cache_line_size) Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+public:
+  explicit MPSCRingBuffer(size_t capacity) {
+    _capacity = 2;
+    while (_capacity < capacity)
+      _capacity <<= 1;
+    _mask = _capacity - 1;
+    _slots = std::make_unique<Slot[]>(_capacity);
+    for (size_t i = 0; i < _capacity; ++i)
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Any thread. Swaps value into a free slot, returns false when the buffer is full (value is left untouched).
+  bool try_push(T &value) {
+    size_t position = _enqueue_position.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &_slots[position & _mask];
+      const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0) {
+        if (_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      } else if (difference < 0) {
+        return false;
+      } else {
+        position = _enqueue_position.load(std::memory_order_relaxed);
+      }
+    }
+    std::swap(slot->value, value);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Published value at (read cursor + offset), nullptr if that slot isn't published yet.
+  T *peek(size_t offset = 0) {
+    const size_t position = _dequeue_position.load(std::memory_order_relaxed) + offset;
+    Slot &slot = _slots[position & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+      return nullptr;
+    return &slot.value;
+  }
+
+  // Consumer only. Hands the first count peeked slots back to producers.
+  void release(size_t count) {
+    size_t position = _dequeue_position.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i, ++position)
+      _slots[position & _mask].sequence.store(position + _capacity, std::memory_order_release);
+    _dequeue_position.store(position, std::memory_order_release);
+  }
+
+  // Number of pushes claimed so far. Once dequeue_position() reaches it, all of those have been consumed.
+  size_t enqueue_position() const { return _enqueue_position.load(std::memory_order_acquire); }
+  size_t dequeue_position() const { return _dequeue_position.load(std::memory_order_acquire); }
+  size_t capacity() const { return _capacity; }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  MPSCRingBuffer(const MPSCRingBuffer &) = delete;
+  MPSCRingBuffer &operator=(const MPSCRingBuffer &) = delete;
+  MPSCRingBuffer(MPSCRingBuffer &&) = delete;
+  MPSCRingBuffer &operator=(MPSCRingBuffer &&) = delete;
+
+private:
+  alignas(cache_line_size) std::atomic<size_t> _enqueue_position{0};
+  alignas(cache_line_size) std::atomic<size_t> _dequeue_position{0};
+  size_t _capacity;
+  size_t _mask;
+  std::unique_ptr<Slot[]> _slots;
+};
+
+} // namespace common_util
@@ -0,0 +1,246 @@
+#pragma once
+#include "memory_map_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace common_util {
+
+/*
+Thread pool running map/reduce scans over mapped records.
+The range is cut into chunks which start on a page and on a record boundary, so no record is split between two
+threads and no page is touched by two threads. Each worker owns a contiguous run of chunks and walks it front to back
+(sequential access, the kernel's read ahead keeps working), a worker that's done steals chunks from the others.
+Workers are pinned to CPUs ordered by NUMA node, so neighbouring runs of the file stay on one node and the page cache
+pages a worker faults in are allocated on its node.
+The results of all chunks are reduced in file order on the calling thread, reduce doesn't need to be commutative.
+  common_util::ParallelScanner scanner;
+  common_util::RMemoryMapped<Trade> trades("trades.bin");
+  const double volume = scanner.scan(
+      trades, 0.0,
+      [](const Trade *begin, const Trade *end) {
+        double qty = 0;
+        for (; begin != end; ++begin)
+          qty += begin->qty;
+        return qty;
+      },
+      std::plus<double>());
+*/
+class ParallelScanner final {
+public:
+  // big enough to amortize scheduling, small enough for stealing to balance uneven chunks
+  static constexpr size_t default_chunk_bytes = 4 << 20;
+
+  explicit ParallelScanner(size_t threads = std::thread::hardware_concurrency(), bool pin_threads = true) {
+    const std::vector<int> cpus = pin_threads ? cpus_by_node() : std::vector<int>();
+    _thread_count = std::max<size_t>(threads, 1);
+    _workers.reserve(_thread_count);
+    for (size_t i = 0; i < _thread_count; ++i) {
+      const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+      _workers.emplace_back(&ParallelScanner::worker_loop, this, i, cpu);
+    }
+  }
+
+  ~ParallelScanner() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _job_ready.notify_all();
+    for (auto &worker : _workers)
+      worker.join();
+  }
+
+  size_t thread_count() const { return _thread_count; }
+
+  /*
+  map(const T *begin, const T *end) -> Result for every chunk, reduce(Result, Result) -> Result folds them starting
+  with init. map runs concurrently on the pool, reduce only on the calling thread. Result has to be default
+  constructible. An exception thrown by map is rethrown here once the other chunks finished.
+  Not reentrant, one scan at a time.
+  */
+  template <typename T, typename Result, typename Map, typename Reduce>
+  Result scan(const T *begin, const T *end, Result init, Map &&map, Reduce &&reduce,
+              size_t chunk_bytes = default_chunk_bytes) {
+    const size_t records = static_cast<size_t>(end - begin);
+    if (!records)
+      return init;
+    const size_t chunk_records = records_per_chunk(sizeof(T), chunk_bytes);
+    // the first chunk ends on the first page and record aligned boundary, every later one is chunk_records long
+    const size_t first_records = std::min(records, first_chunk_records(begin, chunk_records));
+    const size_t chunk_count = 1 + (records - first_records + chunk_records - 1) / chunk_records;
+
+    std::vector<Result> results(chunk_count);
+    run(chunk_count, [&](size_t chunk) {
+      const size_t from = chunk ? first_records + (chunk - 1) * chunk_records : 0;
+      const size_t to = chunk ? std::min(records, from + chunk_records) : first_records;
+      results[chunk] = map(begin + from, begin + to);
+    });
+
+    for (auto &result : results)
+      init = reduce(std::move(init), std::move(result));
+    return init;
+  }
+
+  template <typename T, typename Result, typename Map, typename Reduce>
+  Result scan(RMemoryMapped<T> &file, Result init, Map &&map, Reduce &&reduce,
+              size_t chunk_bytes = default_chunk_bytes) {
+    return scan<T>(file.begin(), file.end(), std::move(init), std::forward<Map>(map), std::forward<Reduce>(reduce),
+                   chunk_bytes);
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  ParallelScanner(const ParallelScanner &) = delete;
+  ParallelScanner &operator=(const ParallelScanner &) = delete;
+  ParallelScanner(ParallelScanner &&) = delete;
+  ParallelScanner &operator=(ParallelScanner &&) = delete;
+
+private:
+  // run of chunks owned by one worker, padded so workers don't share the cursor's cache line
+  struct alignas(64) ChunkRun {
+    std::atomic<size_t> next{0};
+    size_t end = 0;
+  };
+
+  static size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+  }
+
+  // chunk length in records, a multiple of lcm(page, record size) bytes
+  static size_t records_per_chunk(size_t record_size, size_t chunk_bytes) {
+    const size_t unit = std::lcm(page_size(), record_size);
+    const size_t units = std::max<size_t>(1, chunk_bytes / unit);
+    return units * unit / record_size;
+  }
+
+  // mapped files start page aligned, then this is chunk_records. Otherwise search for the first record starting on a
+  // page boundary, chunks from there on line up with pages.
+  template <typename T> static size_t first_chunk_records(const T *begin, size_t chunk_records) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(begin);
+    const size_t page = page_size();
+    for (size_t i = 0; i < chunk_records; ++i)
+      if ((address + i * sizeof(T)) % page == 0)
+        return i ? i : chunk_records;
+    return chunk_records;
+  }
+
+  // CPUs this process may run on, grouped by NUMA node (node0's CPUs first). Falls back to affinity order.
+  static std::vector<int> cpus_by_node() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+      return {};
+    std::vector<int> cpus;
+    std::vector<bool> taken(CPU_SETSIZE, false);
+    for (int node = 0;; ++node) {
+      std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!cpulist)
+        break;
+      std::string range;
+      // "0-3,8-11"
+      while (std::getline(cpulist, range, ',')) {
+        if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0])))
+          continue;
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+          if (CPU_ISSET(cpu, &allowed) && !taken[cpu]) {
+            cpus.push_back(cpu);
+            taken[cpu] = true;
+          }
+      }
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &allowed) && !taken[cpu])
+        cpus.push_back(cpu);
+    return cpus;
+  }
+
+  // splits chunks into one contiguous run per worker and blocks until every chunk ran
+  void run(size_t chunk_count, const std::function<void(size_t)> &task) {
+    const size_t workers = _thread_count;
+    _runs = std::make_unique<ChunkRun[]>(workers);
+    for (size_t i = 0; i < workers; ++i) {
+      _runs[i].next.store(chunk_count * i / workers, std::memory_order_relaxed);
+      _runs[i].end = chunk_count * (i + 1) / workers;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _task = &task;
+    _busy = workers;
+    ++_generation;
+    _job_ready.notify_all();
+    _job_done.wait(lock, [&] { return _busy == 0; });
+    _task = nullptr;
+    if (_error)
+      std::rethrow_exception(std::exchange(_error, nullptr));
+  }
+
+  void worker_loop(size_t index, int cpu) {
+    if (cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    uint64_t seen = 0;
+    for (;;) {
+      const std::function<void(size_t)> *task;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _job_ready.wait(lock, [&] { return _stopping || _generation != seen; });
+        if (_stopping)
+          return;
+        seen = _generation;
+        task = _task;
+      }
+      // own run first, then steal from the following workers
+      std::exception_ptr error;
+      try {
+        for (size_t offset = 0; offset < _thread_count; ++offset) {
+          ChunkRun &run = _runs[(index + offset) % _thread_count];
+          for (size_t chunk; (chunk = run.next.fetch_add(1, std::memory_order_relaxed)) < run.end;)
+            (*task)(chunk);
+        }
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (error && !_error)
+        _error = error;
+      if (--_busy == 0)
+        _job_done.notify_one();
+    }
+  }
+
+  size_t _thread_count = 0;
+  std::vector<std::thread> _workers;
+  std::unique_ptr<ChunkRun[]> _runs;
+  const std::function<void(size_t)> *_task = nullptr;
+  size_t _busy = 0;
+  uint64_t _generation = 0;
+  bool _stopping = false;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _job_ready;
+  std::condition_variable _job_done;
+};
+
+} // namespace common_util
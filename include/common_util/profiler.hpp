@@ -0,0 +1,483 @@
+#pragma once
+#include "Logger.hpp"
+#include "string_format_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define COMMON_UTIL_PROFILE_X86 1
+#endif
+
+/*
+COMMON_UTIL_PROFILE_ZONE compiles to nothing with -DCOMMON_UTIL_PROFILE=0, the classes stay usable.
+*/
+#ifndef COMMON_UTIL_PROFILE
+#define COMMON_UTIL_PROFILE 1
+#endif
+
+namespace common_util {
+
+/*
+Tick source of the profiler: rdtsc where the CPU has an invariant TSC (constant rate, keeps counting in sleep states),
+CLOCK_MONOTONIC_RAW nanoseconds otherwise. Ticks are converted to nanoseconds only when reporting, with a ratio
+measured once against CLOCK_MONOTONIC_RAW (calibrate(), about 10ms, the Profiler does it when it is created).
+*/
+class ProfileClock final {
+public:
+  static uint64_t now() {
+#ifdef COMMON_UTIL_PROFILE_X86
+    if (uses_tsc())
+      return __rdtsc();
+#endif
+    return raw_nanoseconds();
+  }
+
+  static bool uses_tsc() {
+#ifdef COMMON_UTIL_PROFILE_X86
+    static const bool invariant_tsc = [] {
+      unsigned eax, ebx, ecx, edx;
+      return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+    }();
+    return invariant_tsc;
+#else
+    return false;
+#endif
+  }
+
+  static double nanoseconds(uint64_t ticks) { return static_cast<double>(ticks) * calibrate(); }
+
+  // nanoseconds per tick, measured on the first call
+  static double calibrate() {
+    static const double nanoseconds_per_tick = [] {
+      if (!uses_tsc())
+        return 1.0;
+      const uint64_t start_ns = raw_nanoseconds();
+      const uint64_t start_ticks = now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      const uint64_t end_ns = raw_nanoseconds();
+      const uint64_t end_ticks = now();
+      return static_cast<double>(end_ns - start_ns) / static_cast<double>(end_ticks - start_ticks);
+    }();
+    return nanoseconds_per_tick;
+  }
+
+  ProfileClock() = delete;
+
+private:
+  static uint64_t raw_nanoseconds() {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+  }
+};
+
+namespace profile_detail {
+
+constexpr size_t max_zones = 256;
+// log-linear buckets: ticks below 32 exact, above 16 buckets per power of two (at most 1/16 wide)
+constexpr size_t exact_buckets = 32;
+constexpr unsigned sub_bucket_bits = 4;
+constexpr size_t bucket_count = exact_buckets + (64 - 5) * (size_t(1) << sub_bucket_bits);
+
+inline size_t bucket_of(uint64_t ticks) {
+  if (ticks < exact_buckets)
+    return static_cast<size_t>(ticks);
+  const unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(ticks));
+  const size_t sub_bucket = static_cast<size_t>(ticks >> (exponent - sub_bucket_bits)) & 15;
+  return exact_buckets + (exponent - 5) * 16 + sub_bucket;
+}
+
+// smallest ticks of bucket
+inline uint64_t bucket_low(size_t bucket) {
+  if (bucket < exact_buckets)
+    return bucket;
+  const unsigned exponent = static_cast<unsigned>((bucket - exact_buckets) / 16) + 5;
+  return (16 + (bucket - exact_buckets) % 16) << (exponent - sub_bucket_bits);
+}
+
+// largest ticks of bucket
+inline uint64_t bucket_high(size_t bucket) {
+  return bucket + 1 == bucket_count ? UINT64_MAX : bucket_low(bucket + 1) - 1;
+}
+
+/*
+Samples of one zone on one thread. Only the owning thread writes, with plain relaxed load + store instead of atomic
+read-modify-write, the aggregation reads relaxed and may see a sample in count before its bucket. Cache line aligned,
+threads never share a line.
+*/
+struct alignas(64) ZoneCounters {
+  std::atomic<uint64_t> buckets[bucket_count];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> max;
+
+  void record(uint64_t ticks) {
+    std::atomic<uint64_t> &bucket = buckets[bucket_of(ticks)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    total.store(total.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+    if (ticks > max.load(std::memory_order_relaxed))
+      max.store(ticks, std::memory_order_relaxed);
+  }
+};
+
+// zones of one thread, allocated on the thread's first sample in a zone
+struct ThreadProfile {
+  std::atomic<ZoneCounters *> zones[max_zones] = {};
+
+  ZoneCounters &zone(uint32_t id) {
+    ZoneCounters *counters = zones[id].load(std::memory_order_relaxed);
+    if (!counters) {
+      counters = new ZoneCounters();
+      zones[id].store(counters, std::memory_order_release);
+    }
+    return *counters;
+  }
+
+  ~ThreadProfile() {
+    for (std::atomic<ZoneCounters *> &counters : zones)
+      delete counters.load(std::memory_order_relaxed);
+  }
+};
+
+} // namespace profile_detail
+
+// samples of one zone merged over all threads, in ticks
+struct ProfileHistogram {
+  std::string zone;
+  uint64_t count = 0;
+  uint64_t total_ticks = 0;
+  uint64_t max_ticks = 0;
+  std::vector<uint64_t> buckets = std::vector<uint64_t>(profile_detail::bucket_count);
+
+  // ticks at quantile (0 - 1], the middle of its bucket
+  uint64_t quantile(double fraction) const {
+    if (!count)
+      return 0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+      seen += buckets[bucket];
+      if (seen >= rank) {
+        const uint64_t low = profile_detail::bucket_low(bucket);
+        return std::min(low + (profile_detail::bucket_high(bucket) - low) / 2, max_ticks);
+      }
+    }
+    return max_ticks;
+  }
+
+  /*
+  Samples recorded after previous was collected. The maximum of that interval isn't kept, it is the top of the
+  highest bucket that got samples, capped at the overall maximum.
+  */
+  ProfileHistogram since(const ProfileHistogram &previous) const {
+    ProfileHistogram interval;
+    interval.zone = zone;
+    interval.count = count - previous.count;
+    interval.total_ticks = total_ticks - previous.total_ticks;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+      interval.buckets[bucket] = buckets[bucket] - previous.buckets[bucket];
+      if (interval.buckets[bucket])
+        interval.max_ticks = std::min(profile_detail::bucket_high(bucket), max_ticks);
+    }
+    return interval;
+  }
+};
+
+struct ProfileSummary {
+  std::string zone;
+  uint64_t count;
+  double mean_ns;
+  double p50_ns;
+  double p99_ns;
+  double max_ns;
+};
+
+/*
+Registry of named zones and the per thread histograms they record into. Recording takes no lock and no atomic
+read-modify-write: every thread writes its own counters, collect() merges them. A thread's counters outlive it so its
+samples still count, the next new thread takes them over and adds to them. Memory stays at one ThreadProfile (2 KB)
+plus about 7.8 KB per zone used for each thread alive at the same time, not for every thread ever started.
+*/
+class Profiler final {
+public:
+  static Profiler &get_instance() {
+    static Profiler instance;
+    return instance;
+  }
+
+  // id of zone name, the same name gives the same id. Throws std::length_error past max_zones names
+  uint32_t zone(std::string_view name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto found = _zone_ids.find(std::string(name));
+    if (found != _zone_ids.end())
+      return found->second;
+    if (_zone_names.size() == profile_detail::max_zones)
+      throw std::length_error("Too many profile zones");
+    const uint32_t id = static_cast<uint32_t>(_zone_names.size());
+    _zone_names.emplace_back(name);
+    _zone_ids.emplace(_zone_names.back(), id);
+    return id;
+  }
+
+  // one sample of ticks (ProfileClock) in zone id
+  static void record(uint32_t zone, uint64_t ticks) {
+    static thread_local profile_detail::ThreadProfile *thread = nullptr;
+    if (!thread) {
+      thread = get_instance().add_thread();
+      // constructed on the first sample only, the fast path doesn't pay for a thread_local destructor
+      static thread_local const ThreadRetire retire{thread};
+    }
+    thread->zone(zone).record(ticks);
+  }
+
+  // every zone merged over all threads, cumulative since the start
+  std::vector<ProfileHistogram> collect() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<ProfileHistogram> histograms(_zone_names.size());
+    for (size_t id = 0; id < histograms.size(); ++id)
+      histograms[id].zone = _zone_names[id];
+    for (const auto &thread : _threads) {
+      for (size_t id = 0; id < histograms.size(); ++id) {
+        const profile_detail::ZoneCounters *counters = thread->zones[id].load(std::memory_order_acquire);
+        if (!counters)
+          continue;
+        ProfileHistogram &histogram = histograms[id];
+        for (size_t bucket = 0; bucket < profile_detail::bucket_count; ++bucket)
+          histogram.buckets[bucket] += counters->buckets[bucket].load(std::memory_order_relaxed);
+        histogram.count += counters->count.load(std::memory_order_relaxed);
+        histogram.total_ticks += counters->total.load(std::memory_order_relaxed);
+        histogram.max_ticks = std::max(histogram.max_ticks, counters->max.load(std::memory_order_relaxed));
+      }
+    }
+    return histograms;
+  }
+
+  // zones without samples are left out
+  static std::vector<ProfileSummary> summarize(const std::vector<ProfileHistogram> &histograms) {
+    std::vector<ProfileSummary> summaries;
+    for (const ProfileHistogram &histogram : histograms) {
+      if (!histogram.count)
+        continue;
+      summaries.push_back({histogram.zone, histogram.count,
+                           ProfileClock::nanoseconds(histogram.total_ticks) / static_cast<double>(histogram.count),
+                           ProfileClock::nanoseconds(histogram.quantile(0.5)),
+                           ProfileClock::nanoseconds(histogram.quantile(0.99)),
+                           ProfileClock::nanoseconds(histogram.max_ticks)});
+    }
+    return summaries;
+  }
+
+  // {"profile": [{"zone": "parse", "count": 10, "mean_ns": ..., "p50_ns": ..., "p99_ns": ..., "max_ns": ...}]}
+  static std::string to_json(const std::vector<ProfileSummary> &summaries) {
+    std::string json = "{\"profile\": [";
+    for (size_t i = 0; i < summaries.size(); ++i) {
+      const ProfileSummary &summary = summaries[i];
+      json += string_format(i ? ", " : "", "{\"zone\": \"", escape(summary.zone), "\", \"count\": ", summary.count,
+                            ", \"mean_ns\": ", summary.mean_ns, ", \"p50_ns\": ", summary.p50_ns,
+                            ", \"p99_ns\": ", summary.p99_ns, ", \"max_ns\": ", summary.max_ns, "}");
+    }
+    return json + "]}";
+  }
+
+  // one line per zone, "profile parse count=10 mean_ns=... p50_ns=... p99_ns=... max_ns=..."
+  static void log(const std::vector<ProfileSummary> &summaries, Logger &logger,
+                  Logger::Severity severity = Logger::Severity::INFO) {
+    for (const ProfileSummary &summary : summaries)
+      logger.log(string_format("profile ", summary.zone, " count=", summary.count, " mean_ns=", summary.mean_ns,
+                               " p50_ns=", summary.p50_ns, " p99_ns=", summary.p99_ns, " max_ns=", summary.max_ns),
+                 severity);
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  Profiler(const Profiler &) = delete;
+  Profiler(Profiler &&) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+  Profiler &operator=(Profiler &&) = delete;
+
+private:
+  Profiler() { ProfileClock::calibrate(); }
+
+  // hands a ThreadProfile back when its thread exits
+  struct ThreadRetire {
+    profile_detail::ThreadProfile *thread;
+    ~ThreadRetire() { get_instance().retire_thread(thread); }
+  };
+
+  // a profile of an exited thread if there is one, the mutex orders its last writes before the new owner's
+  profile_detail::ThreadProfile *add_thread() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_retired.empty()) {
+      profile_detail::ThreadProfile *thread = _retired.back();
+      _retired.pop_back();
+      return thread;
+    }
+    _threads.push_back(std::make_unique<profile_detail::ThreadProfile>());
+    return _threads.back().get();
+  }
+
+  void retire_thread(profile_detail::ThreadProfile *thread) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _retired.push_back(thread);
+  }
+
+  static std::string escape(std::string_view text) {
+    std::string escaped;
+    for (const char c : text) {
+      if (c == '"' || c == '\\')
+        escaped.push_back('\\');
+      escaped.push_back(c);
+    }
+    return escaped;
+  }
+
+  std::mutex _mutex;
+  std::vector<std::string> _zone_names;
+  std::unordered_map<std::string, uint32_t> _zone_ids;
+  std::vector<std::unique_ptr<profile_detail::ThreadProfile>> _threads;
+  std::vector<profile_detail::ThreadProfile *> _retired;
+};
+
+// a named zone, registered once, e.g. as a function local static
+class ProfileZone final {
+public:
+  explicit ProfileZone(std::string_view name) : _id(Profiler::get_instance().zone(name)) {}
+  uint32_t id() const { return _id; }
+
+private:
+  uint32_t _id;
+};
+
+/*
+Records the time from construction to destruction into zone. Two clock reads and a handful of thread local adds.
+  static const common_util::ProfileZone parse_zone("parse");
+  common_util::ScopedTimer timer(parse_zone);
+*/
+class ScopedTimer final {
+public:
+  explicit ScopedTimer(const ProfileZone &zone) : _zone(zone.id()), _start(ProfileClock::now()) {}
+  ~ScopedTimer() { Profiler::record(_zone, ProfileClock::now() - _start); }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer(ScopedTimer &&) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(ScopedTimer &&) = delete;
+
+private:
+  uint32_t _zone;
+  uint64_t _start;
+};
+
+/*
+Background thread that every period summarizes the samples recorded since its last report and hands them to a
+Logger (one line per zone) or to a callback as JSON. Zones without samples in the period are left out. The
+destructor reports the last partial period.
+  common_util::ProfileReporter reporter(std::chrono::seconds(10), common_util::Logger::get_instance());
+*/
+class ProfileReporter final {
+public:
+  using type_json_callback = std::function<void(const std::string &json)>;
+
+  ProfileReporter(std::chrono::milliseconds period, Logger &logger, Logger::Severity severity = Logger::Severity::INFO)
+      : ProfileReporter(period, [&logger, severity](const std::vector<ProfileSummary> &summaries) {
+          Profiler::log(summaries, logger, severity);
+        }) {}
+
+  ProfileReporter(std::chrono::milliseconds period, type_json_callback callback)
+      : ProfileReporter(period, [callback = std::move(callback)](const std::vector<ProfileSummary> &summaries) {
+          callback(Profiler::to_json(summaries));
+        }) {}
+
+  ~ProfileReporter() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wakeup.notify_one();
+    _thread.join();
+    report();
+  }
+
+  // reports now instead of waiting for the period
+  void report() {
+    std::lock_guard<std::mutex> lock(_report_mutex);
+    std::vector<ProfileHistogram> histograms = Profiler::get_instance().collect();
+    std::vector<ProfileHistogram> intervals;
+    for (size_t id = 0; id < histograms.size(); ++id)
+      intervals.push_back(id < _previous.size() ? histograms[id].since(_previous[id]) : histograms[id]);
+    _previous = std::move(histograms);
+    const std::vector<ProfileSummary> summaries = Profiler::summarize(intervals);
+    if (!summaries.empty())
+      _output(summaries);
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  ProfileReporter(const ProfileReporter &) = delete;
+  ProfileReporter(ProfileReporter &&) = delete;
+  ProfileReporter &operator=(const ProfileReporter &) = delete;
+  ProfileReporter &operator=(ProfileReporter &&) = delete;
+
+private:
+  using type_output = std::function<void(const std::vector<ProfileSummary> &)>;
+
+  // samples from before the reporter existed aren't part of its first period
+  ProfileReporter(std::chrono::milliseconds period, type_output output)
+      : _period(period), _output(std::move(output)), _previous(Profiler::get_instance().collect()),
+        _thread(&ProfileReporter::reporter_loop, this) {}
+
+  void reporter_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_wakeup.wait_for(lock, _period, [this] { return _stop; })) {
+      lock.unlock();
+      report();
+      lock.lock();
+    }
+  }
+
+  std::chrono::milliseconds _period;
+  type_output _output;
+  std::mutex _report_mutex;
+  std::vector<ProfileHistogram> _previous;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  bool _stop = false;
+  // last, the thread starts with everything above constructed
+  std::thread _thread;
+};
+
+} // namespace common_util
+
+#define COMMON_UTIL_PROFILE_CONCAT_INNER(a, b) a##b
+#define COMMON_UTIL_PROFILE_CONCAT(a, b) COMMON_UTIL_PROFILE_CONCAT_INNER(a, b)
+
+/*
+Times the rest of the enclosing scope as zone name (a string literal).
+  void parse_block() {
+    COMMON_UTIL_PROFILE_ZONE("parse_block");
+    ...
+  }
+*/
+#if COMMON_UTIL_PROFILE
+#define COMMON_UTIL_PROFILE_ZONE(name)                                                                             \
+  static const ::common_util::ProfileZone COMMON_UTIL_PROFILE_CONCAT(_cu_profile_zone_, __LINE__)(name);         \
+  const ::common_util::ScopedTimer COMMON_UTIL_PROFILE_CONCAT(_cu_profile_timer_, __LINE__)(                       \
+      COMMON_UTIL_PROFILE_CONCAT(_cu_profile_zone_, __LINE__))
+#else
+#define COMMON_UTIL_PROFILE_ZONE(name) static_cast<void>(0)
+#endif
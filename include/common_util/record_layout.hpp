@@ -0,0 +1,266 @@
+#pragma once
+#include "../endian/endian.hpp"
+#include "memory_map_util.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace common_util {
+
+// byte order of one serialized field, HOST stores it as it is in memory
+enum class ByteOrder : uint8_t { BIG, LITTLE, HOST };
+
+namespace record_layout_detail {
+
+template <typename M> struct MemberTraits;
+template <typename C, typename T> struct MemberTraits<T C::*> {
+  using record = C;
+  using type = T;
+};
+
+constexpr bool swaps(ByteOrder order) {
+  return (order == ByteOrder::BIG && Endian::isLittleEndian()) || (order == ByteOrder::LITTLE && Endian::isBigEndian());
+}
+
+template <ByteOrder Order, typename T> inline void store(char *out, const T &value) {
+  if constexpr (std::is_enum_v<T>) {
+    store<Order>(out, static_cast<std::underlying_type_t<T>>(value));
+  } else if constexpr (std::is_array_v<T> || sizeof(T) == 1 || !swaps(Order)) {
+    std::memcpy(out, &value, sizeof(T));
+  } else {
+    const T swapped = Endian::byteSwap(value);
+    std::memcpy(out, &swapped, sizeof(T));
+  }
+}
+
+template <ByteOrder Order, typename T> inline void load(const char *in, T &value) {
+  if constexpr (std::is_enum_v<T>) {
+    std::underlying_type_t<T> underlying;
+    load<Order>(in, underlying);
+    value = static_cast<T>(underlying);
+  } else {
+    std::memcpy(&value, in, sizeof(T));
+    if constexpr (!std::is_array_v<T> && sizeof(T) > 1 && swaps(Order))
+      value = Endian::byteSwap(value);
+  }
+}
+
+} // namespace record_layout_detail
+
+/*
+One serialized field: a data member and the byte order it is stored in.
+Integers, float, double and enums (stored as their underlying type) are converted, arrays of bytes (char[N],
+uint8_t[N]) are copied as they are.
+*/
+template <auto Member, ByteOrder Order = ByteOrder::BIG> struct Field {
+  using record_type = typename record_layout_detail::MemberTraits<decltype(Member)>::record;
+  using value_type = typename record_layout_detail::MemberTraits<decltype(Member)>::type;
+  static_assert(std::is_arithmetic_v<value_type> || std::is_enum_v<value_type> ||
+                    (std::is_array_v<value_type> && sizeof(std::remove_all_extents_t<value_type>) == 1),
+                "fields are integers, floating point, enums or byte arrays");
+  static_assert(std::is_array_v<value_type> || sizeof(value_type) <= 8, "fields are at most 64 bit");
+
+  static constexpr ByteOrder order = Order;
+  static constexpr size_t size = sizeof(value_type);
+
+  static void store(char *out, const record_type &record) { record_layout_detail::store<Order>(out, record.*Member); }
+  static void load(const char *in, record_type &record) { record_layout_detail::load<Order>(in, record.*Member); }
+};
+
+/*
+Packed on-wire layout of a record, fields in the listed order without padding. Offsets and the record size are
+constants, store() and load() compile to one load/store (plus bswap) per field and check nothing.
+  struct Tick { int64_t timestamp; double price; uint32_t qty; char symbol[8]; };
+  using TickLayout = common_util::RecordLayout<Tick, common_util::Field<&Tick::timestamp>,
+                                               common_util::Field<&Tick::price, common_util::ByteOrder::LITTLE>,
+                                               common_util::Field<&Tick::qty>, common_util::Field<&Tick::symbol>>;
+  static_assert(TickLayout::size == 28);
+*/
+template <typename Record, typename... Fields> class RecordLayout final {
+  static_assert(sizeof...(Fields) > 0, "a layout needs fields");
+  static_assert((std::is_same_v<Record, typename Fields::record_type> && ...), "fields must be members of Record");
+
+public:
+  using record_type = Record;
+  static constexpr size_t field_count = sizeof...(Fields);
+  static constexpr size_t size = (Fields::size + ...);
+
+  template <size_t Index> static constexpr size_t offset() {
+    static_assert(Index < field_count, "no such field");
+    return offsets()[Index];
+  }
+
+  // buffer needs size bytes
+  static void store(void *buffer, const Record &record) {
+    store(static_cast<char *>(buffer), record, std::index_sequence_for<Fields...>());
+  }
+  static void load(const void *buffer, Record &record) {
+    load(static_cast<const char *>(buffer), record, std::index_sequence_for<Fields...>());
+  }
+
+  // count records back to back, buffer needs count * size bytes
+  static void store(void *buffer, const Record *records, size_t count) {
+    char *out = static_cast<char *>(buffer);
+    for (size_t i = 0; i < count; ++i, out += size)
+      store(out, records[i], std::index_sequence_for<Fields...>());
+  }
+  static void load(const void *buffer, Record *records, size_t count) {
+    const char *in = static_cast<const char *>(buffer);
+    for (size_t i = 0; i < count; ++i, in += size)
+      load(in, records[i], std::index_sequence_for<Fields...>());
+  }
+
+  RecordLayout() = delete;
+
+private:
+  static constexpr std::array<size_t, sizeof...(Fields)> offsets() {
+    constexpr size_t sizes[] = {Fields::size...};
+    std::array<size_t, sizeof...(Fields)> result{};
+    for (size_t i = 1; i < result.size(); ++i)
+      result[i] = result[i - 1] + sizes[i - 1];
+    return result;
+  }
+
+  template <size_t... Index> static void store(char *out, const Record &record, std::index_sequence<Index...>) {
+    (Fields::store(out + offset<Index>(), record), ...);
+  }
+  template <size_t... Index> static void load(const char *in, Record &record, std::index_sequence<Index...>) {
+    (Fields::load(in + offset<Index>(), record), ...);
+  }
+};
+
+/*
+Reading position in a buffer or a mapped file. Each read checks the remaining size once for the whole record (or
+array of records), not per field. The *_unchecked variants leave that to the caller.
+Throws std::out_of_range when reading past the end.
+  common_util::RMemoryMapped<char> file("ticks.bin");
+  common_util::ReadCursor cursor(file);
+  while (cursor.remaining() >= TickLayout::size)
+    ticks.push_back(cursor.read<TickLayout>());
+*/
+class ReadCursor final {
+public:
+  ReadCursor(const void *data, size_t size) : _begin(static_cast<const char *>(data)), _size(size) {}
+  template <typename T>
+  explicit ReadCursor(RMemoryMapped<T> &file) : ReadCursor(file.begin(), file.size() * sizeof(T)) {}
+
+  size_t position() const { return _position; }
+  size_t remaining() const { return _size - _position; }
+  const char *current() const { return _begin + _position; }
+
+  void seek(size_t position) {
+    if (position > _size)
+      throw std::out_of_range("Seek past end of buffer");
+    _position = position;
+  }
+  void skip(size_t bytes) {
+    require(bytes);
+    _position += bytes;
+  }
+
+  template <typename Layout> void read(typename Layout::record_type &record) {
+    require(Layout::size);
+    read_unchecked<Layout>(record);
+  }
+  template <typename Layout> typename Layout::record_type read() {
+    typename Layout::record_type record;
+    read<Layout>(record);
+    return record;
+  }
+  template <typename Layout> void read(typename Layout::record_type *records, size_t count) {
+    require_records(Layout::size, count);
+    Layout::load(current(), records, count);
+    _position += count * Layout::size;
+  }
+  template <typename Layout> void read_unchecked(typename Layout::record_type &record) {
+    Layout::load(current(), record);
+    _position += Layout::size;
+  }
+
+  // single value, cursor.read_value<ByteOrder::BIG, uint32_t>()
+  template <ByteOrder Order, typename T> T read_value() {
+    require(sizeof(T));
+    T value;
+    record_layout_detail::load<Order>(current(), value);
+    _position += sizeof(T);
+    return value;
+  }
+
+private:
+  void require(size_t bytes) const {
+    if (remaining() < bytes)
+      throw std::out_of_range("Read past end of buffer");
+  }
+  void require_records(size_t record_size, size_t count) const {
+    if (remaining() / record_size < count)
+      throw std::out_of_range("Read past end of buffer");
+  }
+
+  const char *_begin;
+  size_t _size;
+  size_t _position = 0;
+};
+
+/*
+Writing position in a buffer or a mapped file, the counterpart of ReadCursor.
+Throws std::out_of_range when writing past the end. Writes into a WMemoryMapped go through its memory directly, use
+its flush() (or mark_dirty() before flush_async()) afterwards.
+*/
+class WriteCursor final {
+public:
+  WriteCursor(void *data, size_t size) : _begin(static_cast<char *>(data)), _size(size) {}
+  template <typename T>
+  explicit WriteCursor(WMemoryMapped<T> &file) : WriteCursor(file.begin(), file.size() * sizeof(T)) {}
+
+  size_t position() const { return _position; }
+  size_t remaining() const { return _size - _position; }
+  char *current() const { return _begin + _position; }
+
+  void seek(size_t position) {
+    if (position > _size)
+      throw std::out_of_range("Seek past end of buffer");
+    _position = position;
+  }
+  void skip(size_t bytes) {
+    require(bytes);
+    _position += bytes;
+  }
+
+  template <typename Layout> void write(const typename Layout::record_type &record) {
+    require(Layout::size);
+    write_unchecked<Layout>(record);
+  }
+  template <typename Layout> void write(const typename Layout::record_type *records, size_t count) {
+    if (remaining() / Layout::size < count)
+      throw std::out_of_range("Write past end of buffer");
+    Layout::store(current(), records, count);
+    _position += count * Layout::size;
+  }
+  template <typename Layout> void write_unchecked(const typename Layout::record_type &record) {
+    Layout::store(current(), record);
+    _position += Layout::size;
+  }
+
+  // single value, cursor.write_value<ByteOrder::BIG>(uint32_t(7))
+  template <ByteOrder Order, typename T> void write_value(const T &value) {
+    require(sizeof(T));
+    record_layout_detail::store<Order>(current(), value);
+    _position += sizeof(T);
+  }
+
+private:
+  void require(size_t bytes) const {
+    if (remaining() < bytes)
+      throw std::out_of_range("Write past end of buffer");
+  }
+
+  char *_begin;
+  size_t _size;
+  size_t _position = 0;
+};
+
+} // namespace common_util
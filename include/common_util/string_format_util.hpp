@@ -1,14 +1,110 @@
 #pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace common_util {
+
+namespace string_format_detail {
+
+// types the to_chars path handles, anything else goes through std::ostringstream
+template <typename T> constexpr bool is_direct() {
+  using U = std::decay_t<T>;
+  // wide characters aren't something to_chars or a narrow stream formats as text
+  if constexpr (std::is_same_v<U, wchar_t> || std::is_same_v<U, char16_t> || std::is_same_v<U, char32_t>)
+    return false;
+  return std::is_arithmetic_v<U> || std::is_convertible_v<const T &, std::string_view>;
+}
+
+// appends to [out, end), nullptr once it didn't fit. Matches operator<< with std::fixed and setprecision(Precision)
+template <int Precision, typename T> char *append(char *out, char *end, const T &value) {
+  if (!out)
+    return nullptr;
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    // no boolalpha
+    if (out == end)
+      return nullptr;
+    *out = value ? '1' : '0';
+    return out + 1;
+  } else if constexpr (std::is_same_v<U, char> || std::is_same_v<U, signed char> ||
+                       std::is_same_v<U, unsigned char>) {
+    // streamed as a character, not a number
+    if (out == end)
+      return nullptr;
+    *out = static_cast<char>(value);
+    return out + 1;
+  } else if constexpr (std::is_integral_v<U>) {
+    const auto result = std::to_chars(out, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+  } else if constexpr (std::is_floating_point_v<U>) {
+    const auto result = std::to_chars(out, end, value, std::chars_format::fixed, Precision);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+  } else {
+    const std::string_view text(value);
+    if (static_cast<size_t>(end - out) < text.size())
+      return nullptr;
+    std::memcpy(out, text.data(), text.size());
+    return out + text.size();
+  }
+}
+
+template <int Precision, typename... Args> char *format(char *out, char *end, const Args &...args) {
+  ((out = append<Precision>(out, end, args)), ...);
+  return out;
+}
+
+// grows by doubling until the text fits, allocates only while it is still growing
+template <int Precision, typename... Args> std::string_view format_thread_local(const Args &...args) {
+  thread_local std::vector<char> buffer(256);
+  for (;;) {
+    char *end = format<Precision>(buffer.data(), buffer.data() + buffer.size(), args...);
+    if (end)
+      return std::string_view(buffer.data(), static_cast<size_t>(end - buffer.data()));
+    buffer.resize(buffer.size() * 2);
+  }
+}
+
+} // namespace string_format_detail
+
 template <typename... Args> std::string string_format(Args... args) {
-  std::ostringstream stream;
-  stream << std::fixed << std::setprecision(4);
-  (stream << ... << args);
-  return stream.str();
+  if constexpr ((string_format_detail::is_direct<Args>() && ...)) {
+    return std::string(string_format_detail::format_thread_local<4>(args...));
+  } else {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(4);
+    (stream << ... << args);
+    return stream.str();
+  }
+}
+
+/*
+Allocation free string_format for arithmetic types and strings, std::to_chars without locale or stream state.
+Floating point is fixed with Precision decimals, string_format_to(...) is byte identical to string_format(...).
+Writes into [buffer, buffer + size) and returns the length, throws std::length_error if it doesn't fit.
+  char line[128];
+  const size_t length = common_util::string_format_to(line, sizeof(line), "close ", bar.close, " volume ", bar.volume);
+*/
+template <int Precision = 4, typename... Args>
+size_t string_format_to(char *buffer, size_t size, const Args &...args) {
+  static_assert((string_format_detail::is_direct<Args>() && ...), "arithmetic types and strings only");
+  const char *end = string_format_detail::format<Precision>(buffer, buffer + size, args...);
+  if (!end)
+    throw std::length_error("string_format_to buffer too small");
+  return static_cast<size_t>(end - buffer);
+}
+
+// formats into a buffer owned by the calling thread, the view is valid until its next call on this thread
+template <int Precision = 4, typename... Args> std::string_view string_format_view(const Args &...args) {
+  static_assert((string_format_detail::is_direct<Args>() && ...), "arithmetic types and strings only");
+  return string_format_detail::format_thread_local<Precision>(args...);
 }
 
-} // namespace common_util
\ No newline at end of file
+} // namespace common_util
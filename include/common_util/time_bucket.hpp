@@ -0,0 +1,243 @@
+#pragma once
+#include "civil_time.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMMON_UTIL_BUCKET_X86 1
+#endif
+
+namespace common_util {
+
+namespace time_bucket_detail {
+
+// |x| below this converts to double and back exactly, with room for one interval on top
+constexpr int64_t exact_limit = int64_t(1) << 50;
+// days whose month arithmetic stays inside int32 (about 5.8 million years around 1970)
+constexpr int64_t int32_day_limit = 2000000000;
+constexpr size_t chunk_size = 256;
+
+enum class Round : uint8_t { FLOOR, CEIL, QUOTIENT };
+
+template <Round Mode> inline int64_t round_one(int64_t time, int64_t interval, int64_t origin) {
+  const int64_t x = time - origin;
+  // floor division, the remainder of a negative x is negative
+  const int64_t quotient = x / interval - (x % interval < 0);
+  if constexpr (Mode == Round::QUOTIENT)
+    return quotient;
+  const int64_t floor = quotient * interval;
+  if constexpr (Mode == Round::CEIL)
+    return origin + floor + (floor != x ? interval : 0);
+  return origin + floor;
+}
+
+template <Round Mode>
+inline void round_scalar(const int64_t *times, int64_t *out, size_t count, int64_t interval, int64_t origin) {
+  for (size_t i = 0; i < count; ++i)
+    out[i] = round_one<Mode>(times[i], interval, origin);
+}
+
+#ifdef COMMON_UTIL_BUCKET_X86
+/*
+Four times per register in double precision: (time - origin) / interval rounded down, multiplied back, one correction
+step for a quotient that rounded up. AVX2 has no 64 bit integer division or conversion to double, the magic constant
+1.5 * 2^52 converts exactly in both directions for |x| < 2^51. Registers with a time outside +-2^50 of origin (e.g.
+nanoseconds) fall back to integer division.
+*/
+template <Round Mode>
+__attribute__((target("avx2"))) inline void round_avx2(const int64_t *times, int64_t *out, size_t count,
+                                                       int64_t interval, int64_t origin) {
+  if (interval >= exact_limit) {
+    round_scalar<Mode>(times, out, count, interval, origin);
+    return;
+  }
+  const __m256i magic_bits = _mm256_set1_epi64x(0x4338000000000000);
+  const __m256d magic = _mm256_castsi256_pd(magic_bits);
+  const __m256d step = _mm256_set1_pd(static_cast<double>(interval));
+  const __m256i base = _mm256_set1_epi64x(origin);
+  const __m256i low = _mm256_set1_epi64x(-exact_limit);
+  const __m256i high = _mm256_set1_epi64x(exact_limit);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m256i x = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(times + i)), base);
+    const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(low, x), _mm256_cmpgt_epi64(x, high));
+    if (!_mm256_testz_si256(outside, outside)) {
+      round_scalar<Mode>(times + i, out + i, 4, interval, origin);
+      continue;
+    }
+    const __m256d value = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(x, magic_bits)), magic);
+    __m256d quotient = _mm256_floor_pd(_mm256_div_pd(value, step));
+    // the rounded division is the true quotient or one above it
+    const __m256d above = _mm256_cmp_pd(value, _mm256_mul_pd(quotient, step), _CMP_LT_OQ);
+    quotient = _mm256_sub_pd(quotient, _mm256_and_pd(above, _mm256_set1_pd(1.0)));
+    __m256d result = quotient;
+    if constexpr (Mode != Round::QUOTIENT) {
+      result = _mm256_mul_pd(quotient, step);
+      if constexpr (Mode == Round::CEIL)
+        result = _mm256_add_pd(result, _mm256_and_pd(_mm256_cmp_pd(result, value, _CMP_LT_OQ), step));
+    }
+    __m256i rounded = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(result, magic)), magic_bits);
+    if constexpr (Mode != Round::QUOTIENT)
+      rounded = _mm256_add_epi64(rounded, base);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), rounded);
+  }
+  round_scalar<Mode>(times + i, out + i, count - i, interval, origin);
+}
+#endif
+
+// first day of the month of day, the civil_from_days steps in int32 so the loops over it vectorize
+inline int32_t month_start_day(int32_t day) {
+  const int32_t shifted = day + 719468;
+  const int32_t era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+  const int32_t day_of_era = shifted - era * 146097;
+  const int32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  const int32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  const int32_t shifted_month = (5 * day_of_year + 2) / 153;
+  return day - (day_of_year - (153 * shifted_month + 2) / 5);
+}
+
+inline int64_t month_start_day_wide(int64_t day) {
+  const CivilDate date = civil_from_days(day);
+  return days_from_civil(date.year, date.month, 1);
+}
+
+/*
+Month boundaries of up to chunk_size times: day numbers through the interval kernel, month start in int32, back to
+time units. A month is at most 31 days, start + 31 days is always in the next month.
+*/
+template <bool Ceil, typename Quotient>
+__attribute__((always_inline)) inline void round_month_chunk(const int64_t *times, int64_t *out, size_t count,
+                                                              int64_t day_length, Quotient &&quotient) {
+  int64_t days[chunk_size];
+  quotient(times, days, count, day_length);
+  const auto [smallest, largest] = std::minmax_element(days, days + count);
+  if (*smallest <= -int32_day_limit || *largest >= int32_day_limit) {
+    for (size_t i = 0; i < count; ++i) {
+      const int64_t start_day = month_start_day_wide(days[i]);
+      const int64_t start = start_day * day_length;
+      out[i] = Ceil && start != times[i] ? month_start_day_wide(start_day + 31) * day_length : start;
+    }
+    return;
+  }
+  int32_t starts[chunk_size];
+  for (size_t i = 0; i < count; ++i)
+    starts[i] = month_start_day(static_cast<int32_t>(days[i]));
+  if constexpr (Ceil) {
+    int32_t next[chunk_size];
+    for (size_t i = 0; i < count; ++i)
+      next[i] = month_start_day(starts[i] + 31);
+    for (size_t i = 0; i < count; ++i) {
+      const int64_t start = static_cast<int64_t>(starts[i]) * day_length;
+      out[i] = start == times[i] ? start : static_cast<int64_t>(next[i]) * day_length;
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = static_cast<int64_t>(starts[i]) * day_length;
+  }
+}
+
+template <bool Ceil>
+inline void round_month_scalar(const int64_t *times, int64_t *out, size_t count, int64_t day_length) {
+  const auto quotient = [](const int64_t *in, int64_t *days, size_t n, int64_t length) {
+    round_scalar<Round::QUOTIENT>(in, days, n, length, 0);
+  };
+  for (size_t i = 0; i < count; i += chunk_size)
+    round_month_chunk<Ceil>(times + i, out + i, std::min(chunk_size, count - i), day_length, quotient);
+}
+
+#ifdef COMMON_UTIL_BUCKET_X86
+template <bool Ceil>
+__attribute__((target("avx2"))) inline void round_month_avx2(const int64_t *times, int64_t *out, size_t count,
+                                                             int64_t day_length) {
+  const auto quotient = [](const int64_t *in, int64_t *days, size_t n, int64_t length) {
+    round_avx2<Round::QUOTIENT>(in, days, n, length, 0);
+  };
+  for (size_t i = 0; i < count; i += chunk_size)
+    round_month_chunk<Ceil>(times + i, out + i, std::min(chunk_size, count - i), day_length, quotient);
+}
+#endif
+
+inline bool has_avx2() {
+#ifdef COMMON_UTIL_BUCKET_X86
+  static const bool avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+template <Round Mode>
+inline void round(const int64_t *times, int64_t *out, size_t count, int64_t interval, int64_t origin) {
+  if (interval <= 0)
+    throw std::invalid_argument("Time bucket interval has to be positive");
+#ifdef COMMON_UTIL_BUCKET_X86
+  if (has_avx2())
+    return round_avx2<Mode>(times, out, count, interval, origin);
+#endif
+  round_scalar<Mode>(times, out, count, interval, origin);
+}
+
+template <bool Ceil> inline void round_month(const int64_t *times, int64_t *out, size_t count, int64_t per_second) {
+  if (per_second <= 0)
+    throw std::invalid_argument("Time units per second have to be positive");
+#ifdef COMMON_UTIL_BUCKET_X86
+  if (has_avx2())
+    return round_month_avx2<Ceil>(times, out, count, 86400 * per_second);
+#endif
+  round_month_scalar<Ceil>(times, out, count, 86400 * per_second);
+}
+
+} // namespace time_bucket_detail
+
+/*
+Bar boundaries of whole arrays of epoch times, UTC, integer exact for every int64 input. Times are in any unit,
+per_second says which one for the calendar kernels (1 seconds, 1000 milliseconds, 1000000000 nanoseconds).
+out may be times, e.g. bucketing a WMemoryMapped column in place. Runs AVX2 kernels where the CPU has them.
+  common_util::RMemoryMapped<int64_t> times("ticks.timestamp");
+  std::vector<int64_t> bars(times.size());
+  common_util::time_bucket::floor(times.begin(), bars.data(), times.size(), 60);        // 1m
+  common_util::time_bucket::floor_to_month(times.begin(), bars.data(), times.size());   // 1M
+*/
+namespace time_bucket {
+
+// largest origin + k * interval <= time, interval > 0 (std::invalid_argument otherwise)
+inline void floor(const int64_t *times, int64_t *out, size_t count, int64_t interval, int64_t origin = 0) {
+  time_bucket_detail::round<time_bucket_detail::Round::FLOOR>(times, out, count, interval, origin);
+}
+
+// smallest origin + k * interval >= time
+inline void ceil(const int64_t *times, int64_t *out, size_t count, int64_t interval, int64_t origin = 0) {
+  time_bucket_detail::round<time_bucket_detail::Round::CEIL>(times, out, count, interval, origin);
+}
+
+inline void floor_to_day(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  floor(times, out, count, 86400 * per_second);
+}
+inline void ceil_to_day(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  ceil(times, out, count, 86400 * per_second);
+}
+
+// weeks start Monday 00:00, 1970-01-05 was one
+inline void floor_to_week(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  floor(times, out, count, 7 * 86400 * per_second, 4 * 86400 * per_second);
+}
+inline void ceil_to_week(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  ceil(times, out, count, 7 * 86400 * per_second, 4 * 86400 * per_second);
+}
+
+// first of the month 00:00
+inline void floor_to_month(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  time_bucket_detail::round_month<false>(times, out, count, per_second);
+}
+inline void ceil_to_month(const int64_t *times, int64_t *out, size_t count, int64_t per_second = 1) {
+  time_bucket_detail::round_month<true>(times, out, count, per_second);
+}
+
+} // namespace time_bucket
+
+} // namespace common_util
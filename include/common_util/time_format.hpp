@@ -0,0 +1,250 @@
+#pragma once
+#include "civil_time.hpp"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace common_util {
+
+/*
+strftime style pattern UtcFormatter understands, checked when it's constructed. Constructing a constexpr pattern with
+an unsupported specifier doesn't compile.
+  %Y year  %y year % 100  %m month  %d day  %e space padded day  %j day of year  %H hour  %M minute  %S second
+  %F %Y-%m-%d  %T %H:%M:%S  %D %m/%d/%y  %R %H:%M  %% '%'
+  static constexpr common_util::TimePattern bar_time("%F %T");
+*/
+class TimePattern final {
+public:
+  constexpr TimePattern(std::string_view pattern = "%Y-%m-%d %H:%M:%S")
+      : _pattern(pattern), _max_size(measure(pattern)) {}
+
+  // whether TimePattern(pattern) would be accepted
+  static constexpr bool supported(std::string_view pattern) {
+    for (size_t i = 0; i < pattern.size(); ++i)
+      if (pattern[i] == '%' && (++i == pattern.size() || !width(pattern[i])))
+        return false;
+    return true;
+  }
+
+  constexpr std::string_view pattern() const { return _pattern; }
+  // longest output of one time
+  constexpr size_t max_size() const { return _max_size; }
+
+  // output bytes of a specifier, 0 if unsupported
+  static constexpr size_t width(char specifier) {
+    switch (specifier) {
+    case 'Y':
+      return year_width;
+    case 'F':
+      return year_width + 6;
+    case 'j':
+      return 3;
+    case 'T':
+    case 'D':
+      return 8;
+    case 'R':
+      return 5;
+    case 'y':
+    case 'm':
+    case 'd':
+    case 'e':
+    case 'H':
+    case 'M':
+    case 'S':
+      return 2;
+    case '%':
+      return 1;
+    }
+    return 0;
+  }
+
+private:
+  // sign and digits of the int64 years a time_t reaches
+  static constexpr size_t year_width = 13;
+
+  static constexpr size_t measure(std::string_view pattern) {
+    size_t size = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      if (pattern[i] != '%') {
+        ++size;
+        continue;
+      }
+      if (++i == pattern.size() || !width(pattern[i]))
+        throw std::invalid_argument("Unsupported time format specifier");
+      size += width(pattern[i]);
+    }
+    return size;
+  }
+
+  std::string_view _pattern;
+  size_t _max_size;
+};
+
+/*
+Formats UTC seconds since epoch with integer civil_from_days math, byte identical to std::put_time / strftime over
+gmtime for the supported specifiers. No libc time calls, no shared state: one formatter per thread, formatters aren't
+thread safe themselves.
+The output for the day of the last call is kept with the time of day fields blanked, a time on the same day only
+copies it and writes hour, minute and second.
+  common_util::UtcFormatter formatter;
+  char line[64];
+  const size_t length = formatter.format(bar.close_time, line);
+*/
+class UtcFormatter final {
+public:
+  // copies the pattern text, the TimePattern may view a string that goes away
+  explicit UtcFormatter(const TimePattern &pattern = TimePattern())
+      : _pattern(pattern.pattern()), _max_size(pattern.max_size()) {}
+
+  size_t max_size() const { return _max_size; }
+
+  // buffer needs max_size() bytes, returns the length written
+  size_t format(int64_t time, char *buffer) {
+    const int64_t day = days_from_time(time);
+    if (day != _day)
+      render_day(day);
+    const unsigned second_of_day = static_cast<unsigned>(time - day * 86400);
+    const unsigned fields[] = {second_of_day / 3600, second_of_day / 60 % 60, second_of_day % 60};
+    std::memcpy(buffer, _day_text.data(), _day_text.size());
+    for (const TimeField &field : _time_fields)
+      write_two_digits(buffer + field.offset, fields[field.part]);
+    return _day_text.size();
+  }
+
+  std::string format(int64_t time) {
+    std::string text(max_size(), '\0');
+    text.resize(format(time, text.data()));
+    return text;
+  }
+
+  /*
+  Formats times[0, count) back to back, each one followed by separator. buffer needs count * (max_size() + 1) bytes.
+  Returns the bytes written.
+  */
+  size_t format(const int64_t *times, size_t count, char *buffer, char separator = '\n') {
+    char *out = buffer;
+    for (size_t i = 0; i < count; ++i) {
+      out += format(times[i], out);
+      *out++ = separator;
+    }
+    return static_cast<size_t>(out - buffer);
+  }
+
+private:
+  enum TimePart : uint8_t { HOUR, MINUTE, SECOND };
+  struct TimeField {
+    uint32_t offset;
+    TimePart part;
+  };
+
+  static void write_two_digits(char *out, unsigned value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+  }
+
+  void append_two_digits(unsigned value) {
+    char digits[2];
+    write_two_digits(digits, value);
+    _day_text.append(digits, 2);
+  }
+
+  void append_year(int64_t year) {
+    char digits[24];
+    _day_text.append(digits, std::to_chars(digits, digits + sizeof(digits), year).ptr);
+  }
+
+  void append_time(TimePart part) {
+    _time_fields.push_back({static_cast<uint32_t>(_day_text.size()), part});
+    _day_text.append("00");
+  }
+
+  // the pattern for midnight of day, remembering where the time of day goes
+  void render_day(int64_t day) {
+    const CivilDate date = civil_from_days(day);
+    // strftime's %y of negative years is still 00 - 99
+    const unsigned short_year = static_cast<unsigned>((date.year % 100 + 100) % 100);
+    _day = day;
+    _day_text.clear();
+    _time_fields.clear();
+    const std::string &pattern = _pattern;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      if (pattern[i] != '%') {
+        _day_text.push_back(pattern[i]);
+        continue;
+      }
+      switch (pattern[++i]) {
+      case 'Y':
+        append_year(date.year);
+        break;
+      case 'y':
+        append_two_digits(short_year);
+        break;
+      case 'm':
+        append_two_digits(date.month);
+        break;
+      case 'd':
+        append_two_digits(date.day);
+        break;
+      case 'e':
+        _day_text.push_back(date.day < 10 ? ' ' : static_cast<char>('0' + date.day / 10));
+        _day_text.push_back(static_cast<char>('0' + date.day % 10));
+        break;
+      case 'j': {
+        const unsigned yday = day_of_year(date.year, date.month, date.day) + 1;
+        _day_text.push_back(static_cast<char>('0' + yday / 100));
+        append_two_digits(yday % 100);
+        break;
+      }
+      case 'F':
+        append_year(date.year);
+        _day_text.push_back('-');
+        append_two_digits(date.month);
+        _day_text.push_back('-');
+        append_two_digits(date.day);
+        break;
+      case 'D':
+        append_two_digits(date.month);
+        _day_text.push_back('/');
+        append_two_digits(date.day);
+        _day_text.push_back('/');
+        append_two_digits(short_year);
+        break;
+      case 'H':
+        append_time(HOUR);
+        break;
+      case 'M':
+        append_time(MINUTE);
+        break;
+      case 'S':
+        append_time(SECOND);
+        break;
+      case 'T':
+      case 'R':
+        append_time(HOUR);
+        _day_text.push_back(':');
+        append_time(MINUTE);
+        if (pattern[i] == 'T') {
+          _day_text.push_back(':');
+          append_time(SECOND);
+        }
+        break;
+      case '%':
+        _day_text.push_back('%');
+        break;
+      }
+    }
+  }
+
+  std::string _pattern;
+  size_t _max_size;
+  int64_t _day = INT64_MIN;
+  std::string _day_text;
+  std::vector<TimeField> _time_fields;
+};
+
+} // namespace common_util
@@ -0,0 +1,155 @@
+#pragma once
+#include "civil_time.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace common_util {
+
+// fixed timestamp layouts parse_time() knows, always UTC
+enum class TimeLayout : uint8_t {
+  DATE_TIME, // "2017-10-01 13:45:09", %Y-%m-%d %H:%M:%S
+  ISO_8601,  // "2017-10-01T13:45:09Z" or with 1 to 9 fraction digits "2017-10-01T13:45:09.123456Z"
+};
+
+enum class TimeUnit : uint8_t { SECONDS, NANOSECONDS };
+
+enum class TimeParseStatus : uint8_t {
+  OK,
+  BAD_LENGTH,
+  BAD_DIGIT,     // digit expected
+  BAD_SEPARATOR, // '-', ' ', 'T', ':', '.' or 'Z' expected
+  OUT_OF_RANGE,  // month, day, hour, minute or second
+};
+
+namespace time_parse_detail {
+
+constexpr size_t date_time_size = 19; // "YYYY-MM-DD HH:MM:SS"
+
+inline unsigned two_digits(const char *text) {
+  return static_cast<unsigned>(text[0] - '0') * 10 + static_cast<unsigned>(text[1] - '0');
+}
+
+inline bool is_digit(char c) { return static_cast<unsigned char>(c - '0') <= 9; }
+
+// "YYYY-MM-DD?HH:MM:SS" with separator at 10, all 19 bytes readable
+inline TimeParseStatus check_date_time(const char *text, char separator) {
+#if defined(__SSE2__)
+  // first 16 bytes in one compare: digits where digits belong, the exact separators elsewhere
+  const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text));
+  const __m128i pattern =
+      _mm_setr_epi8('0', '0', '0', '0', '-', '0', '0', '-', '0', '0', separator, '0', '0', ':', '0', '0');
+  const __m128i digit_positions = _mm_setr_epi8(-1, -1, -1, -1, 0, -1, -1, 0, -1, -1, 0, -1, -1, 0, -1, -1);
+  const __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+  const __m128i digits = _mm_cmpeq_epi8(_mm_max_epu8(offset, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+  const __m128i separators = _mm_cmpeq_epi8(bytes, pattern);
+  const __m128i valid = _mm_or_si128(_mm_and_si128(digits, digit_positions),
+                                     _mm_andnot_si128(digit_positions, separators));
+  if (_mm_movemask_epi8(valid) != 0xFFFF) {
+    const int separators_valid = _mm_movemask_epi8(_mm_or_si128(separators, digit_positions));
+    return separators_valid == 0xFFFF ? TimeParseStatus::BAD_DIGIT : TimeParseStatus::BAD_SEPARATOR;
+  }
+#else
+  for (int i = 0; i < 16; ++i) {
+    const char expected = i == 4 || i == 7 ? '-' : i == 10 ? separator : i == 13 ? ':' : '0';
+    if (expected != '0' && text[i] != expected)
+      return TimeParseStatus::BAD_SEPARATOR;
+    if (expected == '0' && !is_digit(text[i]))
+      return TimeParseStatus::BAD_DIGIT;
+  }
+#endif
+  if (text[16] != ':')
+    return TimeParseStatus::BAD_SEPARATOR;
+  if (!is_digit(text[17]) || !is_digit(text[18]))
+    return TimeParseStatus::BAD_DIGIT;
+  return TimeParseStatus::OK;
+}
+
+// fields of a checked "YYYY-MM-DD?HH:MM:SS" to seconds since epoch, same ranges as std::get_time
+inline TimeParseStatus date_time_seconds(const char *text, int64_t &seconds) {
+  const unsigned year = two_digits(text) * 100 + two_digits(text + 2);
+  const unsigned month = two_digits(text + 5);
+  const unsigned day = two_digits(text + 8);
+  const unsigned hour = two_digits(text + 11);
+  const unsigned minute = two_digits(text + 14);
+  const unsigned second = two_digits(text + 17);
+  if (month - 1 > 11 || day - 1 > 30 || hour > 23 || minute > 59 || second > 60)
+    return TimeParseStatus::OUT_OF_RANGE;
+  seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  return TimeParseStatus::OK;
+}
+
+} // namespace time_parse_detail
+
+/*
+Parses one timestamp of a fixed layout (the whole text) to UTC seconds or nanoseconds since epoch.
+Integer only, no locale, no allocation, no exceptions, time is left alone unless OK is returned.
+Seconds of 60 and days past the month's end roll over the way timegm does.
+  int64_t nanoseconds;
+  if (common_util::parse_time<TimeLayout::ISO_8601, TimeUnit::NANOSECONDS>(field, nanoseconds) != TimeParseStatus::OK)
+    ...
+*/
+template <TimeLayout Layout, TimeUnit Unit = TimeUnit::SECONDS>
+TimeParseStatus parse_time(std::string_view text, int64_t &time) noexcept {
+  using namespace time_parse_detail;
+  constexpr char separator = Layout == TimeLayout::DATE_TIME ? ' ' : 'T';
+  if (Layout == TimeLayout::DATE_TIME ? text.size() != date_time_size : text.size() < date_time_size + 1)
+    return TimeParseStatus::BAD_LENGTH;
+  const char *data = text.data();
+  TimeParseStatus status = check_date_time(data, separator);
+  int64_t seconds = 0;
+  if (status != TimeParseStatus::OK || (status = date_time_seconds(data, seconds)) != TimeParseStatus::OK)
+    return status;
+
+  int64_t nanoseconds = 0;
+  if constexpr (Layout == TimeLayout::ISO_8601) {
+    size_t position = date_time_size;
+    if (data[position] == '.') {
+      const size_t fraction_begin = ++position;
+      int64_t scale = 1000000000;
+      for (; position < text.size() && is_digit(data[position]); ++position) {
+        if (position - fraction_begin == 9)
+          return TimeParseStatus::BAD_LENGTH;
+        scale /= 10;
+        nanoseconds += (data[position] - '0') * scale;
+      }
+      if (position == fraction_begin)
+        return TimeParseStatus::BAD_DIGIT;
+    }
+    if (position == text.size() || data[position] != 'Z')
+      return TimeParseStatus::BAD_SEPARATOR;
+    if (position + 1 != text.size())
+      return TimeParseStatus::BAD_LENGTH;
+  }
+
+  if constexpr (Unit == TimeUnit::NANOSECONDS)
+    time = seconds * 1000000000 + nanoseconds;
+  else
+    time = seconds;
+  return TimeParseStatus::OK;
+}
+
+/*
+Parses a column of timestamps into times[0, count). Entries that fail get time INT64_MIN and, if statuses isn't null,
+their status. Returns the number of failures.
+*/
+template <TimeLayout Layout, TimeUnit Unit = TimeUnit::SECONDS>
+size_t parse_times(const std::string_view *texts, size_t count, int64_t *times,
+                   TimeParseStatus *statuses = nullptr) noexcept {
+  size_t failures = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const TimeParseStatus status = parse_time<Layout, Unit>(texts[i], times[i]);
+    if (status != TimeParseStatus::OK) {
+      times[i] = INT64_MIN;
+      ++failures;
+    }
+    if (statuses)
+      statuses[i] = status;
+  }
+  return failures;
+}
+
+} // namespace common_util
@@ -1,5 +1,7 @@
 #pragma once
 #include "string_format_util.hpp"
+#include "time_format.hpp"
+#include "time_parse.hpp"
 #include <ctime>
 #include <iomanip>
 #include <sstream>
@@ -13,6 +15,11 @@ std::cout << std::ctime(&tm);
 Sun Oct  1 00:00:00 2017
 */
 inline std::time_t convert_time_string(const std::string &timeString, const std::string &format = "%Y-%m-%d %H:%M:%S") {
+  // the default layout takes the integer only parser, std::get_time stops after the seconds too
+  int64_t time;
+  if (timeString.size() >= 19 && format == "%Y-%m-%d %H:%M:%S" &&
+      parse_time<TimeLayout::DATE_TIME>(std::string_view(timeString).substr(0, 19), time) == TimeParseStatus::OK)
+    return static_cast<std::time_t>(time);
   std::tm tm = {};
   std::istringstream string_stream(timeString);
   // Parse the time string according to the given format
@@ -28,9 +35,18 @@ inline std::time_t convert_time_string(const std::string &timeString, const std:
 returns string formate from time_t
 */
 inline std::string formate_time_utc(const std::time_t &time, const std::string &format = "%Y-%m-%d %H:%M:%S") {
+  if (format == "%Y-%m-%d %H:%M:%S") {
+    // consecutive bar times mostly share the day, keep its text per thread
+    thread_local UtcFormatter formatter;
+    return formatter.format(time);
+  }
+  if (TimePattern::supported(format))
+    return UtcFormatter(TimePattern(format)).format(time);
+  std::tm utc;
+  if (!gmtime_r(&time, &utc))
+    throw std::runtime_error("Time out of range");
   std::ostringstream stream;
-  std::tm *utc = std::gmtime(&time);
-  stream << std::put_time(utc, format.c_str());
+  stream << std::put_time(&utc, format.c_str());
   return stream.str();
 }
 
@@ -41,11 +57,14 @@ inline std::string duration_to_string(const int64_t duration_sec) {
   return common_util::string_format(hours, ':', minutes, ':', seconds);
 }
 
+// a day past the end of the target month rolls into the next one, as timegm does (Jan 31 + 1 month is Mar 3)
 inline std::time_t add_months(const std::time_t original_time, int months) {
-  std::tm *tm = std::gmtime(&original_time);
-  tm->tm_mon += months;
-  std::time_t new_time = timegm(tm);
-  return new_time;
+  const int64_t day = days_from_time(original_time);
+  const CivilDate date = civil_from_days(day);
+  const int64_t month_index = date.year * 12 + (date.month - 1) + months;
+  const int64_t year = (month_index >= 0 ? month_index : month_index - 11) / 12;
+  const unsigned month = static_cast<unsigned>(month_index - year * 12) + 1;
+  return static_cast<std::time_t>(days_from_civil(year, month, date.day) * 86400 + (original_time - day * 86400));
 }
 
 } // namespace common_util
\ No newline at end of file
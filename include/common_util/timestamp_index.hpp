@@ -0,0 +1,186 @@
+#pragma once
+#include "../endian/endian.hpp"
+#include "memory_map_util.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace common_util {
+
+/*
+Sparse index over records sorted by an int64 key (usually a timestamp), kept in a sidecar file next to the data.
+Every stride-th record contributes its key, by default stride is one page worth of records. The keys are stored in
+Eytzinger (BFS) order: the top levels of the search share a few cache lines and the descent prefetches the
+grandchildren, so a lookup costs about two cache misses in the index and a binary search bounded to one page of the
+data file, which is the only page of it that gets touched.
+
+  sidecar (header integers little endian, written through Endian)
+    magic "CUTSIX01" | uint32 version | uint8 byte order of keys and ranks (0 little, 1 big) | 3 bytes zero
+    uint64 record count | uint64 stride | uint64 entry count
+    zero padding to 64 bytes | int64 keys[entry count + 1] (Eytzinger, 1 based) | uint64 ranks[entry count + 1]
+
+  auto key = [](const Tick &tick) { return tick.timestamp; };
+  common_util::RMemoryMapped<Tick> ticks("ticks.bin");
+  common_util::TimestampIndex::build(ticks.begin(), ticks.end(), key, "ticks.bin.idx");
+  common_util::TimestampIndex index("ticks.bin.idx");
+  const auto [first, last] = index.range(ticks.begin(), ticks.size(), from, to, key);
+*/
+class TimestampIndex final {
+public:
+  static constexpr char magic[8] = {'C', 'U', 'T', 'S', 'I', 'X', '0', '1'};
+  static constexpr uint32_t version = 1;
+
+  // one page of records per index entry
+  template <typename T> static constexpr size_t default_stride() {
+    return sizeof(T) >= 4096 ? 1 : 4096 / sizeof(T);
+  }
+
+  /*
+  Writes the sidecar for [begin, end). Throws std::invalid_argument if the records aren't sorted by key_of,
+  std::system_error if the file can't be written.
+  */
+  template <typename T, typename KeyOf>
+  static void build(const T *begin, const T *end, KeyOf &&key_of, const std::filesystem::path &index_path,
+                    size_t stride = default_stride<T>()) {
+    const uint64_t record_count = static_cast<uint64_t>(end - begin);
+    stride = std::max<size_t>(stride, 1);
+    for (const T *record = begin; record + 1 < end; ++record)
+      if (key_of(record[1]) < key_of(record[0]))
+        throw std::invalid_argument("Records aren't sorted by key, can't index " + index_path.string());
+
+    std::vector<int64_t> sorted_keys;
+    sorted_keys.reserve(record_count / stride + 1);
+    for (uint64_t i = 0; i < record_count; i += stride)
+      sorted_keys.push_back(key_of(begin[i]));
+    const uint64_t entry_count = sorted_keys.size();
+
+    WMemoryMapped<char> file(index_path, keys_offset + 2 * (entry_count + 1) * sizeof(uint64_t));
+    char *out = file.begin();
+    std::memcpy(out, magic, sizeof(magic));
+    out += sizeof(magic);
+    out += Endian::writeLittleEndian(out, version);
+    out[0] = static_cast<char>(Endian::isLittleEndian() ? 0 : 1);
+    out += 4;
+    out += Endian::writeLittleEndian(out, record_count);
+    out += Endian::writeLittleEndian(out, static_cast<uint64_t>(stride));
+    out += Endian::writeLittleEndian(out, entry_count);
+
+    int64_t *keys = reinterpret_cast<int64_t *>(file.begin() + keys_offset);
+    uint64_t *ranks = reinterpret_cast<uint64_t *>(keys + entry_count + 1);
+    keys[0] = INT64_MIN;
+    ranks[0] = 0;
+    size_t next = 0;
+    fill_eytzinger(sorted_keys, keys, ranks, next, 1, entry_count);
+    file.flush();
+  }
+
+  template <typename T, typename KeyOf>
+  static void build(RMemoryMapped<T> &records, KeyOf &&key_of, const std::filesystem::path &index_path,
+                    size_t stride = default_stride<T>()) {
+    build(records.begin(), records.end(), std::forward<KeyOf>(key_of), index_path, stride);
+  }
+
+  // throws std::runtime_error if the file isn't an index, std::system_error if it can't be mapped
+  explicit TimestampIndex(const std::filesystem::path &index_path) : _file(index_path) {
+    const char *data = _file.begin();
+    if (_file.size() < keys_offset || std::memcmp(data, magic, sizeof(magic)) != 0)
+      throw std::runtime_error("Not a timestamp index :- " + index_path.string());
+    size_t position = sizeof(magic);
+    uint32_t file_version;
+    uint64_t stride;
+    position += Endian::readLittleEndian(data + position, file_version);
+    if (file_version != version)
+      throw std::runtime_error("Unsupported timestamp index version " + std::to_string(file_version));
+    if (static_cast<uint8_t>(data[position]) != (Endian::isLittleEndian() ? 0 : 1))
+      throw std::runtime_error("Timestamp index was written with the other byte order");
+    position += 4;
+    position += Endian::readLittleEndian(data + position, _record_count);
+    position += Endian::readLittleEndian(data + position, stride);
+    position += Endian::readLittleEndian(data + position, _entry_count);
+    _stride = stride;
+    if (!_stride || (_file.size() - keys_offset) / (2 * sizeof(uint64_t)) < _entry_count + 1)
+      throw std::runtime_error("Timestamp index truncated :- " + index_path.string());
+    _keys = reinterpret_cast<const int64_t *>(data + keys_offset);
+    _ranks = reinterpret_cast<const uint64_t *>(_keys + _entry_count + 1);
+  }
+
+  uint64_t record_count() const { return _record_count; }
+  size_t stride() const { return _stride; }
+
+  /*
+  Index of the first record with key >= key, count if there is none. records/count have to be the indexed ones,
+  std::invalid_argument otherwise.
+  */
+  template <typename T, typename KeyOf>
+  size_t lower_bound(const T *records, size_t count, int64_t key, KeyOf &&key_of) const {
+    if (count != _record_count)
+      throw std::invalid_argument("Timestamp index was built for " + std::to_string(_record_count) + " records");
+    if (!count)
+      return 0;
+    // first entry with key >= key, the answer is between the entry before it and this one
+    const uint64_t entry = first_entry_not_less(key);
+    if (entry == 0)
+      return 0;
+    const size_t from = (entry - 1) * _stride + 1;
+    const size_t to = entry == _entry_count ? count : entry * _stride;
+    const T *found = std::lower_bound(records + from, records + to, key,
+                                      [&](const T &record, int64_t value) { return key_of(record) < value; });
+    return static_cast<size_t>(found - records);
+  }
+
+  // [first, last) of the records with from <= key < to
+  template <typename T, typename KeyOf>
+  std::pair<size_t, size_t> range(const T *records, size_t count, int64_t from, int64_t to, KeyOf &&key_of) const {
+    const size_t first = lower_bound(records, count, from, key_of);
+    return {first, std::max(first, lower_bound(records, count, to, key_of))};
+  }
+
+  // delete copy assignment, move assignment, copy constructor, move constructor
+  TimestampIndex(const TimestampIndex &) = delete;
+  TimestampIndex &operator=(const TimestampIndex &) = delete;
+  TimestampIndex(TimestampIndex &&) = delete;
+  TimestampIndex &operator=(TimestampIndex &&) = delete;
+
+private:
+  // header, padded so keys[0] starts a cache line and the 8 keys of every node's grandchildren share one
+  static constexpr size_t keys_offset = 64;
+
+  // in-order walk of the implicit tree hands out the sorted keys
+  static void fill_eytzinger(const std::vector<int64_t> &sorted, int64_t *keys, uint64_t *ranks, size_t &next,
+                             uint64_t node, uint64_t size) {
+    if (node > size)
+      return;
+    fill_eytzinger(sorted, keys, ranks, next, 2 * node, size);
+    ranks[node] = next;
+    keys[node] = sorted[next++];
+    fill_eytzinger(sorted, keys, ranks, next, 2 * node + 1, size);
+  }
+
+  // sorted position of the first entry with key >= key, _entry_count if there is none
+  uint64_t first_entry_not_less(int64_t key) const {
+    uint64_t node = 1;
+    while (node <= _entry_count) {
+      // 8 keys per cache line, node * 8 holds the 8 nodes three levels down
+      __builtin_prefetch(_keys + node * 8);
+      node = 2 * node + (_keys[node] < key);
+    }
+    // undo the right turns taken after the last left turn
+    node >>= __builtin_ffsll(static_cast<long long>(~node));
+    return node ? _ranks[node] : _entry_count;
+  }
+
+  RMemoryMapped<char> _file;
+  uint64_t _record_count = 0;
+  size_t _stride = 1;
+  uint64_t _entry_count = 0;
+  const int64_t *_keys = nullptr;
+  const uint64_t *_ranks = nullptr;
+};
+
+} // namespace common_util
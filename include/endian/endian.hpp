@@ -2,6 +2,11 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMMON_UTIL_ENDIAN_X86 1
+#endif
 
 namespace common_util {
 
@@ -35,8 +40,12 @@ public:
   Endian &operator=(const Endian &) = delete;
   Endian &operator=(Endian &&) = delete;
 
-  static bool isBigEndian();
-  static bool isLittleEndian();
+  // byte order of the host, known at compile time
+  static constexpr bool isBigEndian() { return __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__; }
+  static constexpr bool isLittleEndian() { return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__; }
+
+  // reverse the bytes of one integer, float or double
+  template <typename T> static T byteSwap(T value);
 
   /*------------------------Read------------------------------------*/
 
@@ -89,425 +98,361 @@ public:
 
   static size_t writeLittleEndian(void *buffer, int64_t value);
   static size_t writeLittleEndian(void *buffer, uint64_t value);
+
+  /*------------------------Bulk------------------------------------*/
+  /*
+    Arrays of 16, 32, 64 bit integers, float and double. Bytes are reversed with SSSE3/AVX2 pshufb where the CPU has
+    it (picked at runtime), __builtin_bswap otherwise. Conversions to the host's own order are a memmove.
+    buffer and values may be the same memory, e.g. a mapped file converted in place.
+  */
+
+  // read count big endian values from buffer, returns count of read bytes.
+  template <typename T> static size_t readBigEndian(const void *buffer, T *values, size_t count);
+  template <typename T> static size_t readLittleEndian(const void *buffer, T *values, size_t count);
+
+  // write count values to buffer as big endian, returns count of written bytes.
+  template <typename T> static size_t writeBigEndian(void *buffer, const T *values, size_t count);
+  template <typename T> static size_t writeLittleEndian(void *buffer, const T *values, size_t count);
+
+  // in place between big (little) endian and host order, the same call converts both ways.
+  template <typename T> static void convertBigEndian(T *values, size_t count);
+  template <typename T> static void convertLittleEndian(T *values, size_t count);
+
+  // reverse the bytes of every value in place, whatever the host order.
+  template <typename T> static void byteSwap(T *values, size_t count);
+
+private:
+  template <typename T> static void checkBulkType();
+  // swapped or plain copy of count values of sizeof(T) bytes, from may be to
+  template <typename T> static void convert(const void *from, void *to, size_t count, bool swap);
 };
 
 /*--------------------------------implementation---------------------------------*/
 
-/*
-x86 architecture is little-endian. And this lib suppose to run on x86.
-I am putting true and false as default. Would need to return little/big endian
-for other case.
-*/
-inline bool Endian::isBigEndian() { return false; };
-inline bool Endian::isLittleEndian() { return true; };
+namespace endian_detail {
 
-inline size_t Endian::readBigEndian(const void *buffer, int16_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[0];
+using SwapArray = void (*)(const uint8_t *from, uint8_t *to, size_t count);
+
+template <typename U> inline U swapScalar(U value) {
+  if constexpr (sizeof(U) == 2)
+    return __builtin_bswap16(value);
+  else if constexpr (sizeof(U) == 4)
+    return __builtin_bswap32(value);
+  else
+    return __builtin_bswap64(value);
+}
+
+// unsigned integer of Size bytes
+template <size_t Size> struct Unsigned;
+template <> struct Unsigned<2> {
+  using type = uint16_t;
+};
+template <> struct Unsigned<4> {
+  using type = uint32_t;
+};
+template <> struct Unsigned<8> {
+  using type = uint64_t;
+};
+
+// memcpy per value, from and to may be unaligned or the same
+template <size_t Size> inline void swapArrayScalar(const uint8_t *from, uint8_t *to, size_t count) {
+  using U = typename Unsigned<Size>::type;
+  for (size_t i = 0; i < count; ++i) {
+    U value;
+    std::memcpy(&value, from + i * Size, Size);
+    value = swapScalar(value);
+    std::memcpy(to + i * Size, &value, Size);
+  }
+}
+
+#ifdef COMMON_UTIL_ENDIAN_X86
+// pshufb control reversing every Size byte group of 16 bytes
+template <size_t Size> inline void shuffleMask(uint8_t (&mask)[16]) {
+  for (size_t i = 0; i < 16; ++i)
+    mask[i] = static_cast<uint8_t>(i / Size * Size + Size - 1 - i % Size);
+}
+
+template <size_t Size>
+__attribute__((target("ssse3"))) inline void swapArraySsse3(const uint8_t *from, uint8_t *to, size_t count) {
+  uint8_t bytes[16];
+  shuffleMask<Size>(bytes);
+  const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+  const size_t vectors = count * Size / 16;
+  for (size_t i = 0; i < vectors; ++i) {
+    const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from) + i);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(to) + i, _mm_shuffle_epi8(value, mask));
+  }
+  const size_t done = vectors * 16 / Size;
+  swapArrayScalar<Size>(from + done * Size, to + done * Size, count - done);
+}
+
+// the shuffle works within 128 bit halves, no value crosses one
+template <size_t Size>
+__attribute__((target("avx2"))) inline void swapArrayAvx2(const uint8_t *from, uint8_t *to, size_t count) {
+  uint8_t bytes[16];
+  shuffleMask<Size>(bytes);
+  const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes)));
+  const size_t vectors = count * Size / 32;
+  size_t i = 0;
+  for (; i + 4 <= vectors; i += 4) {
+    const __m256i *in = reinterpret_cast<const __m256i *>(from) + i;
+    __m256i *out = reinterpret_cast<__m256i *>(to) + i;
+    const __m256i a = _mm256_loadu_si256(in);
+    const __m256i b = _mm256_loadu_si256(in + 1);
+    const __m256i c = _mm256_loadu_si256(in + 2);
+    const __m256i d = _mm256_loadu_si256(in + 3);
+    _mm256_storeu_si256(out, _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256(out + 1, _mm256_shuffle_epi8(b, mask));
+    _mm256_storeu_si256(out + 2, _mm256_shuffle_epi8(c, mask));
+    _mm256_storeu_si256(out + 3, _mm256_shuffle_epi8(d, mask));
+  }
+  for (; i < vectors; ++i) {
+    const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from) + i);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(to) + i, _mm256_shuffle_epi8(value, mask));
   }
+  const size_t done = vectors * 32 / Size;
+  swapArrayScalar<Size>(from + done * Size, to + done * Size, count - done);
+}
+#endif
+
+template <size_t Size> inline SwapArray selectSwapArray() {
+#ifdef COMMON_UTIL_ENDIAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return swapArrayAvx2<Size>;
+  if (__builtin_cpu_supports("ssse3"))
+    return swapArraySsse3<Size>;
+#endif
+  return swapArrayScalar<Size>;
+}
+
+template <size_t Size> inline void swapArray(const void *from, void *to, size_t count) {
+  static const SwapArray swap = selectSwapArray<Size>();
+  swap(static_cast<const uint8_t *>(from), static_cast<uint8_t *>(to), count);
+}
+
+} // namespace endian_detail
+
+template <typename T> inline T Endian::byteSwap(T value) {
+  static_assert(std::is_arithmetic_v<T> && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8),
+                "16, 32, 64 bit integers, float and double");
+  using U = typename endian_detail::Unsigned<sizeof(T)>::type;
+  U bits;
+  std::memcpy(&bits, &value, sizeof(T));
+  bits = endian_detail::swapScalar(bits);
+  std::memcpy(&value, &bits, sizeof(T));
+  return value;
+}
+
+template <typename T> inline void Endian::checkBulkType() {
+  static_assert(std::is_arithmetic_v<T> && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8),
+                "16, 32, 64 bit integers, float and double");
+}
+
+template <typename T> inline void Endian::convert(const void *from, void *to, size_t count, bool swap) {
+  checkBulkType<T>();
+  if (swap)
+    endian_detail::swapArray<sizeof(T)>(from, to, count);
+  else if (from != to)
+    std::memmove(to, from, count * sizeof(T));
+}
+
+template <typename T> inline size_t Endian::readBigEndian(const void *buffer, T *values, size_t count) {
+  convert<T>(buffer, values, count, !isBigEndian());
+  return count * sizeof(T);
+}
+
+template <typename T> inline size_t Endian::readLittleEndian(const void *buffer, T *values, size_t count) {
+  convert<T>(buffer, values, count, isBigEndian());
+  return count * sizeof(T);
+}
+
+template <typename T> inline size_t Endian::writeBigEndian(void *buffer, const T *values, size_t count) {
+  convert<T>(values, buffer, count, !isBigEndian());
+  return count * sizeof(T);
+}
+
+template <typename T> inline size_t Endian::writeLittleEndian(void *buffer, const T *values, size_t count) {
+  convert<T>(values, buffer, count, isBigEndian());
+  return count * sizeof(T);
+}
+
+template <typename T> inline void Endian::convertBigEndian(T *values, size_t count) {
+  convert<T>(values, values, count, !isBigEndian());
+}
+
+template <typename T> inline void Endian::convertLittleEndian(T *values, size_t count) {
+  convert<T>(values, values, count, isBigEndian());
+}
+
+template <typename T> inline void Endian::byteSwap(T *values, size_t count) { convert<T>(values, values, count, true); }
+
+inline size_t Endian::readBigEndian(const void *buffer, int16_t &value) {
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 2;
 }
 
 inline size_t Endian::readBigEndian(const void *buffer, uint16_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[0];
-  }
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 2;
 }
 
 inline size_t Endian::readBigEndian(const void *buffer, int32_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[0];
-  }
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 4;
 }
 
 inline size_t Endian::readBigEndian(const void *buffer, uint32_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[0];
-  }
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 4;
 }
 
 inline size_t Endian::readBigEndian(const void *buffer, int64_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[7];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[7];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[0];
-  }
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 8;
 }
 
 inline size_t Endian::readBigEndian(const void *buffer, uint64_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[7];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[7];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[0];
-  }
+  std::memcpy(&value, buffer, sizeof(value));
+  if (!isBigEndian())
+    value = byteSwap(value);
   return 8;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, int16_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 2;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, uint16_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 2;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, int32_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 4;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, uint32_t &value) {
-
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 4;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, int64_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[7];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[7];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 8;
 }
 
 inline size_t Endian::readLittleEndian(const void *buffer, uint64_t &value) {
-  if (isBigEndian()) {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[7];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[0];
-  } else {
-    ((uint8_t *)&value)[0] = ((const uint8_t *)buffer)[0];
-    ((uint8_t *)&value)[1] = ((const uint8_t *)buffer)[1];
-    ((uint8_t *)&value)[2] = ((const uint8_t *)buffer)[2];
-    ((uint8_t *)&value)[3] = ((const uint8_t *)buffer)[3];
-    ((uint8_t *)&value)[4] = ((const uint8_t *)buffer)[4];
-    ((uint8_t *)&value)[5] = ((const uint8_t *)buffer)[5];
-    ((uint8_t *)&value)[6] = ((const uint8_t *)buffer)[6];
-    ((uint8_t *)&value)[7] = ((const uint8_t *)buffer)[7];
-  }
-
+  std::memcpy(&value, buffer, sizeof(value));
+  if (isBigEndian())
+    value = byteSwap(value);
   return 8;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, int16_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 2;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, uint16_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 2;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, int32_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 4;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, uint32_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 4;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, int64_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[7];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[7];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 8;
 }
 
 inline size_t Endian::writeBigEndian(void *buffer, uint64_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[7];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[7];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[0];
-  }
-
+  if (!isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 8;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, int16_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-  }
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 2;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, uint16_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-  }
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 2;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, int32_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-  }
-
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 4;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, uint32_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-  }
-
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 4;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, int64_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[7];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[7];
-  }
-
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 8;
 }
 
 inline size_t Endian::writeLittleEndian(void *buffer, uint64_t value) {
-  if (isBigEndian()) {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[7];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[0];
-  } else {
-    ((uint8_t *)buffer)[0] = ((const uint8_t *)&value)[0];
-    ((uint8_t *)buffer)[1] = ((const uint8_t *)&value)[1];
-    ((uint8_t *)buffer)[2] = ((const uint8_t *)&value)[2];
-    ((uint8_t *)buffer)[3] = ((const uint8_t *)&value)[3];
-    ((uint8_t *)buffer)[4] = ((const uint8_t *)&value)[4];
-    ((uint8_t *)buffer)[5] = ((const uint8_t *)&value)[5];
-    ((uint8_t *)buffer)[6] = ((const uint8_t *)&value)[6];
-    ((uint8_t *)buffer)[7] = ((const uint8_t *)&value)[7];
-  }
-
+  if (isBigEndian())
+    value = byteSwap(value);
+  std::memcpy(buffer, &value, sizeof(value));
   return 8;
 }
 
-} // namespace common_util
\ No newline at end of file
+} // namespace common_util
@@ -0,0 +1,33 @@
+#include "common_util/binary_log.hpp"
+#include "common_util/memory_map_util.hpp"
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+/*
+Turns a binary log written by BinaryLogSink back into Logger's text format.
+  log_decode trace.blog            -> stdout
+  log_decode trace.blog trace.log  -> file
+*/
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: " << argv[0] << " <binary log> [output file]\n";
+    return 1;
+  }
+  try {
+    common_util::RMemoryMapped<char> binary_log(argv[1]);
+    common_util::BinaryLogDecoder decoder(binary_log.begin(), binary_log.size());
+    if (argc == 3) {
+      std::ofstream output(argv[2], std::ios::out);
+      if (!output)
+        throw std::runtime_error(std::string("Can't open output file ") + argv[2]);
+      decoder.decode(output);
+    } else {
+      decoder.decode(std::cout);
+    }
+  } catch (const std::exception &error) {
+    std::cerr << error.what() << '\n';
+    return 1;
+  }
+  return 0;
+}